@@ -0,0 +1,375 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
+#include "animation.h"
+#include "picio.h"
+
+
+rect_t find_changed_area(const uint8_t *const a, const uint8_t *const b, const int w, const int h)
+{
+	const size_t row_bytes = size_t(w) * 3;
+
+	int y_top = 0;
+	while(y_top < h && memcmp(&a[y_top * row_bytes], &b[y_top * row_bytes], row_bytes) == 0)
+		y_top++;
+
+	if (y_top == h)
+		return { 0, 0, 0, 0 };
+
+	int y_bottom = h - 1;
+	while(memcmp(&a[y_bottom * row_bytes], &b[y_bottom * row_bytes], row_bytes) == 0)
+		y_bottom--;
+
+	int x_left  = w - 1;
+	int x_right = 0;
+
+	for(int y=y_top; y<=y_bottom; y++) {
+		const size_t offset = y * row_bytes;
+
+		for(int x=0; x<x_left; x++) {
+			if (memcmp(&a[offset + x * 3], &b[offset + x * 3], 3)) {
+				x_left = x;
+				break;
+			}
+		}
+
+		for(int x=w - 1; x>x_right; x--) {
+			if (memcmp(&a[offset + x * 3], &b[offset + x * 3], 3)) {
+				x_right = x;
+				break;
+			}
+		}
+	}
+
+	x_right = std::max(x_left, x_right);
+
+	return { x_left, y_top, x_right - x_left + 1, y_bottom - y_top + 1 };
+}
+
+static void put_le16(std::vector<uint8_t> *const out, const int v)
+{
+	out->push_back(v);
+	out->push_back(v >> 8);
+}
+
+static void put_be32(std::vector<uint8_t> *const out, const uint32_t v)
+{
+	out->push_back(v >> 24);
+	out->push_back(v >> 16);
+	out->push_back(v >> 8);
+	out->push_back(v);
+}
+
+animation_writer::animation_writer(const int w, const int h) :
+	w(w), h(h)
+{
+}
+
+animation_writer::~animation_writer()
+{
+}
+
+gif_writer::gif_writer(const int w, const int h, const rgb_t *const palette_in) :
+	animation_writer(w, h)
+{
+	for(int i=0; i<256; i++) {
+		palette[i * 3 + 0] = palette_in[i].r;
+		palette[i * 3 + 1] = palette_in[i].g;
+		palette[i * 3 + 2] = palette_in[i].b;
+	}
+}
+
+gif_writer::~gif_writer()
+{
+}
+
+uint8_t gif_writer::get_index(const uint8_t *const rgb)
+{
+	const uint32_t key = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+
+	// a terminal has few colors: search once per color
+	auto it = nearest.find(key);
+	if (it != nearest.end())
+		return it->second;
+
+	int best_index    = 0;
+	int best_distance = INT32_MAX;
+
+	for(int i=0; i<256 && best_distance; i++) {
+		const int dr = rgb[0] - palette[i * 3 + 0];
+		const int dg = rgb[1] - palette[i * 3 + 1];
+		const int db = rgb[2] - palette[i * 3 + 2];
+		const int distance = dr * dr + dg * dg + db * db;
+
+		if (distance < best_distance) {
+			best_distance = distance;
+			best_index    = i;
+		}
+	}
+
+	nearest.insert({ key, best_index });
+
+	return best_index;
+}
+
+std::vector<uint8_t> gif_writer::get_header(const int /*n_frames*/)
+{
+	std::vector<uint8_t> out { 'G', 'I', 'F', '8', '9', 'a' };
+
+	put_le16(&out, w);
+	put_le16(&out, h);
+	out.push_back(0xf7);  // global color table of 256 entries
+	out.push_back(0);     // background color
+	out.push_back(0);     // aspect ratio
+	out.insert(out.end(), palette, palette + sizeof palette);
+
+	// loop forever
+	const uint8_t netscape[] { 0x21, 0xff, 0x0b, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+	out.insert(out.end(), netscape, netscape + sizeof netscape);
+
+	return out;
+}
+
+// variable length LZW codes (9...12 bit, 8 bit pixels) as GIF wants them;
+// the dictionary is an open addressing hash table of (prefix, pixel)
+static void gif_lzw(const std::vector<uint8_t> & pixels, std::vector<uint8_t> *const out)
+{
+	constexpr int clear_code = 256;
+	constexpr int eoi_code   = 257;
+	constexpr int table_bits = 13;  // room for 4096 codes
+	constexpr int table_size = 1 << table_bits;
+
+	std::vector<uint32_t> keys(table_size);  // (prefix << 8 | pixel) + 1, 0 is free
+	std::vector<uint16_t> codes(table_size);
+
+	std::vector<uint8_t> packed;
+	uint32_t bits   = 0;
+	int      n_bits = 0;
+
+	auto emit = [&packed, &bits, &n_bits](const int code, const int code_size) {
+		bits   |= uint32_t(code) << n_bits;
+		n_bits += code_size;
+
+		while(n_bits >= 8) {
+			packed.push_back(bits);
+			bits  >>= 8;
+			n_bits -= 8;
+		}
+	};
+
+	int code_size = 9;
+	int next_code = eoi_code + 1;
+
+	emit(clear_code, code_size);
+
+	int prefix = pixels[0];
+
+	for(size_t i=1; i<pixels.size(); i++) {
+		const uint32_t key  = ((uint32_t(prefix) << 8) | pixels[i]) + 1;
+		uint32_t       slot = (key * 2654435761u) >> (32 - table_bits);
+
+		while(keys[slot] && keys[slot] != key)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (keys[slot] == key) {
+			prefix = codes[slot];
+			continue;
+		}
+
+		emit(prefix, code_size);
+
+		keys [slot] = key;
+		codes[slot] = next_code;
+
+		if (next_code >= (1 << code_size))
+			code_size++;
+
+		if (next_code == 4095) {  // dictionary full: start over
+			emit(clear_code, code_size);
+
+			std::fill(keys.begin(), keys.end(), 0);
+			code_size = 9;
+			next_code = eoi_code + 1;
+		}
+		else {
+			next_code++;
+		}
+
+		prefix = pixels[i];
+	}
+
+	emit(prefix, code_size);
+
+	// the decoder adds a table entry for this last code as well, and then
+	// reads the next code one bit wider if the table reached 2^code_size
+	if (next_code == (1 << code_size) && code_size < 12)
+		code_size++;
+
+	emit(eoi_code, code_size);
+
+	if (n_bits)
+		packed.push_back(bits);
+
+	// sub-blocks of at most 255 bytes
+	out->push_back(8);  // minimum code size
+
+	for(size_t i=0; i<packed.size(); i += 255) {
+		const size_t n = std::min(size_t(255), packed.size() - i);
+
+		out->push_back(n);
+		out->insert(out->end(), packed.begin() + i, packed.begin() + i + n);
+	}
+
+	out->push_back(0);
+}
+
+std::vector<uint8_t> gif_writer::add_frame(const uint8_t *const rgb, const rect_t & r_in, const int delay_ms)
+{
+	const rect_t r = first ? rect_t { 0, 0, w, h } : r_in;
+	first = false;
+
+	std::vector<uint8_t> out;
+
+	// graphic control extension: keep what is outside this frame
+	out.push_back(0x21);
+	out.push_back(0xf9);
+	out.push_back(4);
+	out.push_back(1 << 2);  // disposal: do not dispose
+	put_le16(&out, std::min(65535, (delay_ms + 5) / 10));
+	out.push_back(0);  // no transparent color
+	out.push_back(0);
+
+	// image descriptor
+	out.push_back(0x2c);
+	put_le16(&out, r.x);
+	put_le16(&out, r.y);
+	put_le16(&out, r.w);
+	put_le16(&out, r.h);
+	out.push_back(0);  // global color table, not interlaced
+
+	std::vector<uint8_t> indexes(size_t(r.w) * r.h);
+	uint32_t previous_rgb   = 0xffffffff;
+	uint8_t  previous_index = 0;
+
+	for(int y=0; y<r.h; y++) {
+		const uint8_t *row = &rgb[(size_t(r.y + y) * w + r.x) * 3];
+
+		for(int x=0; x<r.w; x++) {
+			const uint8_t *p   = &row[x * 3];
+			const uint32_t key = (p[0] << 16) | (p[1] << 8) | p[2];
+
+			// runs of the same color are the rule
+			if (key != previous_rgb) {
+				previous_rgb   = key;
+				previous_index = get_index(p);
+			}
+
+			indexes[size_t(y) * r.w + x] = previous_index;
+		}
+	}
+
+	gif_lzw(indexes, &out);
+
+	return out;
+}
+
+std::vector<uint8_t> gif_writer::get_trailer()
+{
+	return { 0x3b };
+}
+
+apng_writer::apng_writer(const int w, const int h, const int compression_level) :
+	animation_writer(w, h),
+	compression_level(compression_level)
+{
+}
+
+apng_writer::~apng_writer()
+{
+}
+
+static void png_put_chunk(std::vector<uint8_t> *const out, const char *const type, const std::vector<uint8_t> & data)
+{
+	put_be32(out, data.size());
+
+	const size_t start = out->size();
+	out->insert(out->end(), type, type + 4);
+	out->insert(out->end(), data.begin(), data.end());
+
+	put_be32(out, crc32(0, &(*out)[start], 4 + data.size()));
+}
+
+std::vector<uint8_t> apng_writer::get_header(const int n_frames)
+{
+	std::vector<uint8_t> out { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+
+	std::vector<uint8_t> ihdr;
+	put_be32(&ihdr, w);
+	put_be32(&ihdr, h);
+	ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });  // 8 bit RGB, deflate, no interlace
+	png_put_chunk(&out, "IHDR", ihdr);
+
+	// a deliberate deviation from the APNG specification, which requires
+	// num_frames to equal the number of fcTL chunks: a stream does not know
+	// its length when the header is sent, so it claims INT32_MAX (the
+	// largest value allowed) frames. Browsers show the frames as they
+	// arrive; a stream that ends (on a resize) has fewer frames than it
+	// claimed, which strict decoders may report at the IEND
+	std::vector<uint8_t> actl;
+	put_be32(&actl, n_frames > 0 ? n_frames : INT32_MAX);
+	put_be32(&actl, 0);  // loop forever
+	png_put_chunk(&out, "acTL", actl);
+
+	return out;
+}
+
+std::vector<uint8_t> apng_writer::add_frame(const uint8_t *const rgb, const rect_t & r_in, const int delay_ms)
+{
+	const rect_t r = first ? rect_t { 0, 0, w, h } : r_in;
+
+	std::vector<uint8_t> out;
+
+	std::vector<uint8_t> fctl;
+	put_be32(&fctl, sequence_nr++);
+	put_be32(&fctl, r.w);
+	put_be32(&fctl, r.h);
+	put_be32(&fctl, r.x);
+	put_be32(&fctl, r.y);
+	fctl.push_back(std::min(65535, delay_ms) >> 8);  // delay in ms
+	fctl.push_back(std::min(65535, delay_ms));
+	fctl.push_back(1000 >> 8);
+	fctl.push_back(1000 & 255);
+	fctl.push_back(0);  // dispose: none
+	fctl.push_back(0);  // blend: source
+	png_put_chunk(&out, "fcTL", fctl);
+
+	std::vector<uint8_t> crop(size_t(r.w) * r.h * 3);
+	for(int y=0; y<r.h; y++)
+		memcpy(&crop[size_t(y) * r.w * 3], &rgb[(size_t(r.y + y) * w + r.x) * 3], r.w * 3);
+
+	std::vector<uint8_t> compressed = png_compress_rgb(r.w, r.h, compression_level, crop.data());
+
+	// the first frame is also the image for viewers without APNG support
+	if (first)
+		png_put_chunk(&out, "IDAT", compressed);
+	else {
+		std::vector<uint8_t> fdat;
+		put_be32(&fdat, sequence_nr++);
+		fdat.insert(fdat.end(), compressed.begin(), compressed.end());
+		png_put_chunk(&out, "fdAT", fdat);
+	}
+
+	first = false;
+
+	return out;
+}
+
+std::vector<uint8_t> apng_writer::get_trailer()
+{
+	std::vector<uint8_t> out;
+	png_put_chunk(&out, "IEND", { });
+
+	return out;
+}
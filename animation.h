@@ -0,0 +1,74 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+
+// the bounding box of where two RGB images of w x h differ; w == 0 when
+// they are the same
+rect_t find_changed_area(const uint8_t *const a, const uint8_t *const b, const int w, const int h);
+
+// builds an animated image a frame at a time so that it can be sent while
+// it grows: get_header(), then add_frame() for every frame (which only
+// stores the changed area; the rest stays as it was) and get_trailer()
+class animation_writer
+{
+protected:
+	const int w { 0 };
+	const int h { 0 };
+
+public:
+	animation_writer(const int w, const int h);
+	virtual ~animation_writer();
+
+	// 'n_frames' is 0 when not known in advance (a stream); does not
+	// depend on the frames, so it can also be made after them
+	virtual std::vector<uint8_t> get_header (const int n_frames) = 0;
+
+	// 'rgb' is the complete image, 'r' the part of it that changed; the
+	// first frame is always complete
+	virtual std::vector<uint8_t> add_frame  (const uint8_t *const rgb, const rect_t & r, const int delay_ms) = 0;
+
+	virtual std::vector<uint8_t> get_trailer() = 0;
+};
+
+// GIF89a with a fixed 256 color palette (the xterm colors); other colors
+// (anti-aliasing) become the nearest palette entry
+class gif_writer : public animation_writer
+{
+private:
+	uint8_t palette[256 * 3] { };
+	std::unordered_map<uint32_t, uint8_t> nearest;
+	bool    first { true };
+
+	uint8_t get_index(const uint8_t *const rgb);
+
+public:
+	gif_writer(const int w, const int h, const rgb_t *const palette_in);
+	virtual ~gif_writer();
+
+	std::vector<uint8_t> get_header (const int n_frames) override;
+	std::vector<uint8_t> add_frame  (const uint8_t *const rgb, const rect_t & r, const int delay_ms) override;
+	std::vector<uint8_t> get_trailer() override;
+};
+
+// APNG; frames are RGB, a partial frame is drawn over the previous one
+class apng_writer : public animation_writer
+{
+private:
+	const int compression_level { 0 };
+	uint32_t  sequence_nr       { 0 };
+	bool      first             { true };
+
+public:
+	apng_writer(const int w, const int h, const int compression_level);
+	virtual ~apng_writer();
+
+	std::vector<uint8_t> get_header (const int n_frames) override;
+	std::vector<uint8_t> add_frame  (const uint8_t *const rgb, const rect_t & r, const int delay_ms) override;
+	std::vector<uint8_t> get_trailer() override;
+};
@@ -0,0 +1,109 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <stdint.h>
+#include <freetype2/ft2build.h>
+#include FT_FREETYPE_H
+
+#include "common.h"
+
+
+// glyph bitmap -> RGB, used by font_freetype (and tests/blit-bench.cpp)
+typedef struct {
+	rgb_t   fg;
+	rgb_t   bg;
+	int     max;
+	int     max1;
+	int     underline_row;      // -1 if none
+	int     strikethrough_row;  // -1 if none
+	uint8_t line[3];
+} blit_parameters_t;
+
+typedef void (*blit_kernel_t)(const FT_Bitmap *const bitmap, const blit_parameters_t & p, uint8_t *const result, const int result_width);
+
+static inline void blend(uint8_t *const out, const int pixel_v, const int sub, const rgb_t & fg, const rgb_t & bg)
+{
+	out[0] = (pixel_v * fg.r + sub * bg.r) >> 8;
+	out[1] = (pixel_v * fg.g + sub * bg.g) >> 8;
+	out[2] = (pixel_v * fg.b + sub * bg.b) >> 8;
+}
+
+// all choices are made at compile time so that the pixel loops have no branches
+template<int pixel_mode, bool invert, bool has_color, bool decorated>
+static void blit_kernel(const FT_Bitmap *const bitmap, const blit_parameters_t & p, uint8_t *const result, const int result_width)
+{
+	for(int glyph_y=0; glyph_y<int(bitmap->rows); glyph_y++) {
+		uint8_t *out = &result[glyph_y * result_width * 3];
+
+		if constexpr (decorated) {
+			if (glyph_y == p.underline_row || glyph_y == p.strikethrough_row) {
+				for(int glyph_x=0; glyph_x<result_width; glyph_x++, out += 3) {
+					out[0] = p.line[0];
+					out[1] = p.line[1];
+					out[2] = p.line[2];
+				}
+
+				continue;
+			}
+		}
+
+		const uint8_t *const in = &bitmap->buffer[glyph_y * bitmap->pitch];
+
+		for(int glyph_x=0; glyph_x<result_width; glyph_x++, out += 3) {
+			if constexpr (pixel_mode == FT_PIXEL_MODE_MONO || pixel_mode == FT_PIXEL_MODE_GRAY) {
+				int pixel_v = 0;
+
+				if constexpr (pixel_mode == FT_PIXEL_MODE_MONO)
+					pixel_v = ((in[glyph_x >> 3] >> (7 - (glyph_x & 7))) & 1) * p.max1;
+				else
+					pixel_v = (in[glyph_x] * p.max) >> 8;
+
+				const int sub = p.max1 - pixel_v;
+
+				if constexpr (invert)
+					blend(out, sub, pixel_v, p.fg, p.bg);
+				else
+					blend(out, pixel_v, sub, p.fg, p.bg);
+			}
+			else {
+				// LCD is RGB, BGRA is BGR + alpha
+				constexpr int bpp      = pixel_mode == FT_PIXEL_MODE_LCD ? 3 : 4;
+				constexpr int r_offset = pixel_mode == FT_PIXEL_MODE_LCD ? 0 : 2;
+				constexpr int b_offset = 2 - r_offset;
+
+				int pixel_vr = (in[glyph_x * bpp + r_offset] * p.max) >> 8;
+				int pixel_vg = (in[glyph_x * bpp + 1       ] * p.max) >> 8;
+				int pixel_vb = (in[glyph_x * bpp + b_offset] * p.max) >> 8;
+
+				if constexpr (invert) {
+					pixel_vr = p.max1 - pixel_vr;
+					pixel_vg = p.max1 - pixel_vg;
+					pixel_vb = p.max1 - pixel_vb;
+				}
+
+				if constexpr (has_color) {
+					out[0] = pixel_vr;
+					out[1] = pixel_vg;
+					out[2] = pixel_vb;
+				}
+				else {
+					blend(out, pixel_vr, (pixel_mode == FT_PIXEL_MODE_LCD ? p.max : p.max1) - pixel_vr, p.fg, p.bg);
+				}
+			}
+		}
+	}
+}
+
+#define BLIT_KERNELS(mode) \
+	{ { { blit_kernel<mode, false, false, false>, blit_kernel<mode, false, false, true> },   \
+	    { blit_kernel<mode, false, true,  false>, blit_kernel<mode, false, true,  true> } }, \
+	  { { blit_kernel<mode, true,  false, false>, blit_kernel<mode, true,  false, true> },   \
+	    { blit_kernel<mode, true,  true,  false>, blit_kernel<mode, true,  true,  true> } } }
+
+// [pixel mode][invert][has color][underline and/or strikethrough]
+static const blit_kernel_t blit_kernels[4][2][2][2] {
+	BLIT_KERNELS(FT_PIXEL_MODE_MONO),
+	BLIT_KERNELS(FT_PIXEL_MODE_GRAY),
+	BLIT_KERNELS(FT_PIXEL_MODE_LCD),
+	BLIT_KERNELS(FT_PIXEL_MODE_BGRA)
+};
@@ -0,0 +1,359 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "boxdrawing.h"
+
+
+// per character the weight of the up, right, down and left arm:
+// 0 none, 1 light, 2 heavy, 3 double
+static const char *const box_arms[] = {
+	"0101", "0202", "1010", "2020", "0101", "0202", "1010", "2020",  // 2500
+	"0101", "0202", "1010", "2020", "0110", "0210", "0120", "0220",  // 2508
+	"0011", "0012", "0021", "0022", "1100", "1200", "2100", "2200",  // 2510
+	"1001", "1002", "2001", "2002", "1110", "1210", "2110", "1120",  // 2518
+	"2120", "2210", "1220", "2220", "1011", "1012", "2011", "1021",  // 2520
+	"2021", "2012", "1022", "2022", "0111", "0112", "0211", "0212",  // 2528
+	"0121", "0122", "0221", "0222", "1101", "1102", "1201", "1202",  // 2530
+	"2101", "2102", "2201", "2202", "1111", "1112", "1211", "1212",  // 2538
+	"2111", "1121", "2121", "2112", "2211", "1122", "1221", "2212",  // 2540
+	"1222", "2122", "2221", "2222", "0101", "0202", "1010", "2020",  // 2548
+	"0303", "3030", "0310", "0130", "0330", "0013", "0031", "0033",  // 2550
+	"1300", "3100", "3300", "1003", "3001", "3003", "1310", "3130",  // 2558
+	"3330", "1013", "3031", "3033", "0313", "0131", "0333", "1303",  // 2560
+	"3101", "3303", "1313", "3131", "3333", "0110", "0011", "1001",  // 2568
+	"1100", "0000", "0000", "0000", "0001", "1000", "0100", "0010",  // 2570
+	"0002", "2000", "0200", "0020", "0201", "1020", "0102", "2010",  // 2578
+};
+
+// upper left, upper right, lower left, lower right for U+2596...U+259F
+static const uint8_t quadrants[] = { 4, 8, 1, 13, 9, 7, 11, 2, 6, 14 };
+
+class canvas
+{
+private:
+	uint8_t  *const out;
+	const int       w;
+	const int       h;
+
+public:
+	canvas(uint8_t *const out, const int w, const int h) : out(out), w(w), h(h) {
+		memset(out, 0x00, w * h);
+	}
+
+	int get_width()  const { return w; }
+	int get_height() const { return h; }
+
+	void fill(int x0, int y0, int x1, int y1, const uint8_t v = 255) {
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, w);
+		y1 = std::min(y1, h);
+
+		for(int y=y0; y<y1; y++) {
+			for(int x=x0; x<x1; x++)
+				out[y * w + x] = std::max(out[y * w + x], v);
+		}
+	}
+
+	void put(const int x, const int y, const double coverage) {
+		if (x < 0 || y < 0 || x >= w || y >= h || coverage <= 0.)
+			return;
+
+		uint8_t v = coverage >= 1. ? 255 : uint8_t(coverage * 255);
+		out[y * w + x] = std::max(out[y * w + x], v);
+	}
+};
+
+static void draw_arms(canvas & c, const int u, const int r, const int d, const int l)
+{
+	const int W  = c.get_width ();
+	const int H  = c.get_height();
+	const int t  = std::max(1, (W + 4) / 10);  // light
+	const int th = t * 2 + 1;                   // heavy
+	const int g  = t;                           // offset of the lines of a double
+	const int cx = W / 2;
+	const int cy = H / 2;
+
+	auto thick = [t, th](const int weight) { return weight == 2 ? th : t; };
+	auto lo    = [](const int center, const int k) { return center - k / 2; };
+	auto hi    = [](const int center, const int k) { return center - k / 2 + k; };
+
+	// where a single/heavy arm should stop, given the perpendicular arms
+	auto near_edge = [&](const int center, const int a, const int b, const bool toward_a) {
+		// a, b: the perpendicular arms; returns the outer most edge of them
+		int  rc    = toward_a ? INT32_MAX : INT32_MIN;
+		bool found = false;
+
+		for(int weight : { a, b }) {
+			if (weight == 0)
+				continue;
+
+			found = true;
+
+			int e = 0;
+			if (weight == 3) {
+				// only cover both lines of a double when it is a corner
+				bool both = a && b;
+				if (toward_a)
+					e = both ? lo(center + g, t) : lo(center - g, t);
+				else
+					e = both ? hi(center - g, t) : hi(center + g, t);
+			}
+			else {
+				e = toward_a ? lo(center, thick(weight)) : hi(center, thick(weight));
+			}
+
+			rc = toward_a ? std::min(rc, e) : std::max(rc, e);
+		}
+
+		return found ? rc : center;
+	};
+
+	// where one line of a double arm should stop
+	auto double_edge = [&](const int center, const int same_side, const int opposite, const int other_side, const bool start) {
+		if (same_side) {
+			if (start)
+				return same_side == 3 ? lo(center + g, t) : lo(center, thick(same_side));
+			return same_side == 3 ? hi(center - g, t) : hi(center, thick(same_side));
+		}
+
+		if (opposite)
+			return center;
+
+		if (other_side) {
+			if (start)
+				return other_side == 3 ? lo(center - g, t) : lo(center, thick(other_side));
+			return other_side == 3 ? hi(center + g, t) : hi(center, thick(other_side));
+		}
+
+		return center;
+	};
+
+	// up
+	if (u == 3) {
+		c.fill(lo(cx - g, t), 0, hi(cx - g, t), double_edge(cy, l, d, r, false));
+		c.fill(lo(cx + g, t), 0, hi(cx + g, t), double_edge(cy, r, d, l, false));
+	}
+	else if (u) {
+		c.fill(lo(cx, thick(u)), 0, hi(cx, thick(u)), d ? cy : near_edge(cy, l, r, false));
+	}
+
+	// down
+	if (d == 3) {
+		c.fill(lo(cx - g, t), double_edge(cy, l, u, r, true), hi(cx - g, t), H);
+		c.fill(lo(cx + g, t), double_edge(cy, r, u, l, true), hi(cx + g, t), H);
+	}
+	else if (d) {
+		c.fill(lo(cx, thick(d)), u ? cy : near_edge(cy, l, r, true), hi(cx, thick(d)), H);
+	}
+
+	// right
+	if (r == 3) {
+		c.fill(double_edge(cx, u, l, d, true), lo(cy - g, t), W, hi(cy - g, t));
+		c.fill(double_edge(cx, d, l, u, true), lo(cy + g, t), W, hi(cy + g, t));
+	}
+	else if (r) {
+		c.fill(l ? cx : near_edge(cx, u, d, true), lo(cy, thick(r)), W, hi(cy, thick(r)));
+	}
+
+	// left
+	if (l == 3) {
+		c.fill(0, lo(cy - g, t), double_edge(cx, u, r, d, false), hi(cy - g, t));
+		c.fill(0, lo(cy + g, t), double_edge(cx, d, r, u, false), hi(cy + g, t));
+	}
+	else if (l) {
+		c.fill(0, lo(cy, thick(l)), r ? cx : near_edge(cx, u, d, false), hi(cy, thick(l)));
+	}
+}
+
+static void draw_dashes(canvas & c, const bool horizontal, const int weight, const int n)
+{
+	const int W = c.get_width ();
+	const int H = c.get_height();
+	const int t = std::max(1, (W + 4) / 10);
+	const int k = weight == 2 ? t * 2 + 1 : t;
+
+	const int length = horizontal ? W : H;
+	const int gap    = std::max(1, length / n / 3);
+
+	for(int i=0; i<n; i++) {
+		int start = i * length / n;
+		int end   = (i + 1) * length / n - gap;
+
+		if (horizontal)
+			c.fill(start, H / 2 - k / 2, end, H / 2 - k / 2 + k);
+		else
+			c.fill(W / 2 - k / 2, start, W / 2 - k / 2 + k, end);
+	}
+}
+
+static void draw_arc(canvas & c, const bool right, const bool down)
+{
+	const int    W  = c.get_width ();
+	const int    H  = c.get_height();
+	const int    t  = std::max(1, (W + 4) / 10);
+	const double lx = W / 2 - t / 2 + t / 2.;  // center of the vertical line
+	const double ly = H / 2 - t / 2 + t / 2.;  // center of the horizontal line
+	const int    sx = right ? 1 : -1;
+	const int    sy = down  ? 1 : -1;
+	const double r  = std::min(right ? W - lx : lx, down ? H - ly : ly);
+	const double ccx= lx + sx * r;
+	const double ccy= ly + sy * r;
+
+	for(int y=0; y<H; y++) {
+		for(int x=0; x<W; x++) {
+			double px = x + 0.5 - ccx;
+			double py = y + 0.5 - ccy;
+
+			if (px * sx > 0 || py * sy > 0)
+				continue;
+
+			double dist = std::sqrt(px * px + py * py);
+
+			c.put(x, y, t / 2. + 0.5 - std::fabs(dist - r));
+		}
+	}
+
+	// straight parts, one of these has length 0
+	if (down)
+		c.fill(W / 2 - t / 2, int(ccy), W / 2 - t / 2 + t, H);
+	else
+		c.fill(W / 2 - t / 2, 0, W / 2 - t / 2 + t, int(std::ceil(ccy)));
+
+	if (right)
+		c.fill(int(ccx), H / 2 - t / 2, W, H / 2 - t / 2 + t);
+	else
+		c.fill(0, H / 2 - t / 2, int(std::ceil(ccx)), H / 2 - t / 2 + t);
+}
+
+static void draw_diagonal(canvas & c, const bool rising)
+{
+	const int    W    = c.get_width ();
+	const int    H    = c.get_height();
+	const int    t    = std::max(1, (W + 4) / 10);
+	const double norm = std::sqrt(double(W) * W + double(H) * H);
+
+	for(int y=0; y<H; y++) {
+		for(int x=0; x<W; x++) {
+			double px   = x + 0.5;
+			double py   = y + 0.5;
+			double dist = rising ? std::fabs(H * px + W * py - W * H) / norm : std::fabs(H * px - W * py) / norm;
+
+			c.put(x, y, t / 2. + 0.5 - dist);
+		}
+	}
+}
+
+static void draw_block(canvas & c, const UChar32 ch)
+{
+	const int W = c.get_width ();
+	const int H = c.get_height();
+
+	auto eighth_h = [H](const int n) { return (H * n + 4) / 8; };
+	auto eighth_w = [W](const int n) { return (W * n + 4) / 8; };
+
+	if (ch == 0x2580)  // upper half
+		c.fill(0, 0, W, H / 2);
+	else if (ch >= 0x2581 && ch <= 0x2588)  // lower n eighths, full block
+		c.fill(0, H - eighth_h(ch - 0x2580), W, H);
+	else if (ch >= 0x2589 && ch <= 0x258f)  // left n eighths
+		c.fill(0, 0, eighth_w(0x2590 - ch), H);
+	else if (ch == 0x2590)  // right half
+		c.fill(W / 2, 0, W, H);
+	else if (ch >= 0x2591 && ch <= 0x2593)  // shades, flat so that they tile
+		c.fill(0, 0, W, H, (ch - 0x2590) * 64);
+	else if (ch == 0x2594)  // upper eighth
+		c.fill(0, 0, W, eighth_h(1));
+	else if (ch == 0x2595)  // right eighth
+		c.fill(W - eighth_w(1), 0, W, H);
+	else {
+		uint8_t q = quadrants[ch - 0x2596];
+
+		if (q & 1)
+			c.fill(0, 0, W / 2, H / 2);
+		if (q & 2)
+			c.fill(W / 2, 0, W, H / 2);
+		if (q & 4)
+			c.fill(0, H / 2, W / 2, H);
+		if (q & 8)
+			c.fill(W / 2, H / 2, W, H);
+	}
+}
+
+static void draw_braille(canvas & c, const UChar32 ch)
+{
+	const int    W      = c.get_width ();
+	const int    H      = c.get_height();
+	const int    bits   = ch - 0x2800;
+	const double radius = std::max(0.75, std::min(W / 4., H / 8.) * 0.6);
+
+	// dots 1-6 are in the upper 3 rows, 7 and 8 in the lower one
+	static const int dot_x[] = { 0, 0, 0, 1, 1, 1, 0, 1 };
+	static const int dot_y[] = { 0, 1, 2, 0, 1, 2, 3, 3 };
+
+	for(int dot=0; dot<8; dot++) {
+		if ((bits & (1 << dot)) == 0)
+			continue;
+
+		double center_x = W * (dot_x[dot] * 2 + 1) / 4.;
+		double center_y = H * (dot_y[dot] * 2 + 1) / 8.;
+
+		for(int y=int(center_y - radius - 1); y<=int(center_y + radius + 1); y++) {
+			for(int x=int(center_x - radius - 1); x<=int(center_x + radius + 1); x++) {
+				double dx = x + 0.5 - center_x;
+				double dy = y + 0.5 - center_y;
+
+				c.put(x, y, radius + 0.5 - std::sqrt(dx * dx + dy * dy));
+			}
+		}
+	}
+}
+
+bool is_box_drawing(const UChar32 c)
+{
+	return (c >= 0x2500 && c <= 0x259f) || (c >= 0x2800 && c <= 0x28ff);
+}
+
+bool render_box_drawing(const UChar32 ch, const int width, const int height, uint8_t *const out)
+{
+	if (!is_box_drawing(ch) || width <= 0 || height <= 0)
+		return false;
+
+	canvas c(out, width, height);
+
+	if (ch >= 0x2800)
+		draw_braille(c, ch);
+	else if (ch >= 0x2580)
+		draw_block(c, ch);
+	else if (ch >= 0x256d && ch <= 0x2570)
+		draw_arc(c, ch == 0x256d || ch == 0x2570, ch == 0x256d || ch == 0x256e);
+	else if (ch == 0x2571)
+		draw_diagonal(c, true);
+	else if (ch == 0x2572)
+		draw_diagonal(c, false);
+	else if (ch == 0x2573) {
+		draw_diagonal(c, true);
+		draw_diagonal(c, false);
+	}
+	else {
+		const char *arms = box_arms[ch - 0x2500];
+		int         u    = arms[0] - '0';
+		int         r    = arms[1] - '0';
+		int         d    = arms[2] - '0';
+		int         l    = arms[3] - '0';
+
+		if ((ch >= 0x2504 && ch <= 0x250b) || (ch >= 0x254c && ch <= 0x254f)) {
+			int n = ch >= 0x254c ? 2 : (ch >= 0x2508 ? 4 : 3);
+
+			draw_dashes(c, r != 0, std::max(r, u), n);
+		}
+		else {
+			draw_arms(c, u, r, d, l);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,14 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <stdint.h>
+
+#include <unicode/umachine.h>
+
+
+// box drawing (U+2500...U+257F), block elements (U+2580...U+259F) and
+// braille (U+2800...U+28FF) are drawn by code instead of via a font
+bool is_box_drawing(const UChar32 c);
+
+// 'out' receives width * height coverage values (0...255)
+bool render_box_drawing(const UChar32 c, const int width, const int height, uint8_t *const out);
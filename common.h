@@ -5,3 +5,10 @@ typedef struct {
 	int g;
 	int b;
 } rgb_t;
+
+typedef struct {
+	int x;
+	int y;
+	int w;
+	int h;
+} rect_t;
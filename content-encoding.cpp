@@ -0,0 +1,130 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <memory>
+#include <stdlib.h>
+#if defined(HAVE_LZ4)
+#include <lz4frame.h>
+#endif
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "content-encoding.h"
+#include "error.h"
+#include "str.h"
+
+
+// fast settings: the point is less bandwidth for little cpu
+#define ZSTD_LEVEL 1
+#define LZ4_LEVEL  0
+
+std::vector<std::string> get_content_encodings()
+{
+	std::vector<std::string> out;
+#if defined(HAVE_ZSTD)
+	out.push_back("zstd");
+#endif
+#if defined(HAVE_LZ4)
+	out.push_back("lz4");
+#endif
+	return out;
+}
+
+std::optional<std::string> select_content_encoding(const std::string & accept_encoding)
+{
+	const std::vector<std::string> supported = get_content_encodings();
+
+	std::optional<std::string> selected;
+	double                     selected_q = 0.;
+	size_t                     selected_i = supported.size();
+
+	// e.g. "gzip, zstd;q=0.9, lz4"
+	for(auto & element: split(accept_encoding, ",")) {
+		auto   parts = split(element, ";");
+		if (parts.empty())
+			continue;
+
+		std::string coding = str_tolower(trim(parts.at(0)));
+		double      q      = 1.;
+
+		for(size_t i=1; i<parts.size(); i++) {
+			std::string parameter = trim(parts.at(i));
+
+			if (parameter.substr(0, 2) == "q=")
+				q = atof(parameter.substr(2).c_str());
+		}
+
+		for(size_t i=0; i<supported.size(); i++) {
+			if (coding != supported.at(i) && coding != "*")
+				continue;
+
+			// on equal q the one we prefer
+			if (q > selected_q || (q == selected_q && q > 0. && i < selected_i)) {
+				selected   = supported.at(i);
+				selected_q = q;
+				selected_i = i;
+			}
+
+			break;
+		}
+	}
+
+	return selected;
+}
+
+// "in" is unused when termcamng is built without zstd and lz4
+encoded_t compress_content(const std::string & content_encoding, [[maybe_unused]] const encoded_t & in)
+{
+#if defined(HAVE_ZSTD)
+	if (content_encoding == "zstd") {
+		thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+
+		size_t   bound = ZSTD_compressBound(in.len);
+		uint8_t *out   = reinterpret_cast<uint8_t *>(malloc(bound));
+		if (!out)
+			error_exit(true, "compress_content: cannot allocate %zu bytes", bound);
+
+		size_t len = ZSTD_compressCCtx(cctx.get(), out, bound, in.data.get(), in.len, ZSTD_LEVEL);
+		if (ZSTD_isError(len))
+			error_exit(false, "compress_content: zstd failed: %s", ZSTD_getErrorName(len));
+
+		return make_encoded(reinterpret_cast<uint8_t *>(realloc(out, len)), len);
+	}
+#endif
+
+#if defined(HAVE_LZ4)
+	// the frame format (not raw blocks) so that a client knows the size
+	if (content_encoding == "lz4") {
+		thread_local std::unique_ptr<LZ4F_cctx, decltype(&LZ4F_freeCompressionContext)> cctx([] {
+				LZ4F_cctx *ctx = nullptr;
+				if (LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION)))
+					error_exit(false, "compress_content: cannot create lz4 context");
+				return ctx;
+			}(), LZ4F_freeCompressionContext);
+
+		LZ4F_preferences_t prefs { };
+		prefs.frameInfo.contentSize = in.len;
+		prefs.compressionLevel      = LZ4_LEVEL;
+
+		size_t   bound = LZ4F_compressFrameBound(in.len, &prefs);
+		uint8_t *out   = reinterpret_cast<uint8_t *>(malloc(bound));
+		if (!out)
+			error_exit(true, "compress_content: cannot allocate %zu bytes", bound);
+
+		size_t len = LZ4F_compressBegin(cctx.get(), out, bound, &prefs);
+		if (!LZ4F_isError(len)) {
+			size_t rc = LZ4F_compressUpdate(cctx.get(), out + len, bound - len, in.data.get(), in.len, nullptr);
+			if (!LZ4F_isError(rc)) {
+				len += rc;
+				rc   = LZ4F_compressEnd(cctx.get(), out + len, bound - len, nullptr);
+			}
+			len = LZ4F_isError(rc) ? rc : len + rc;
+		}
+		if (LZ4F_isError(len))
+			error_exit(false, "compress_content: lz4 failed: %s", LZ4F_getErrorName(len));
+
+		return make_encoded(reinterpret_cast<uint8_t *>(realloc(out, len)), len);
+	}
+#endif
+
+	error_exit(false, "compress_content: unsupported content-encoding \"%s\"", content_encoding.c_str());
+}
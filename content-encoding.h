@@ -0,0 +1,20 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+
+
+// the transport compressions this build supports ("zstd", "lz4"), in order
+// of preference
+std::vector<std::string>   get_content_encodings();
+
+// picks a supported Content-Encoding from an Accept-Encoding header;
+// nothing for identity
+std::optional<std::string> select_content_encoding(const std::string & accept_encoding);
+
+// compresses with a per-thread context that is reused for every frame
+encoded_t                  compress_content(const std::string & content_encoding, const encoded_t & in);
@@ -0,0 +1,207 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+#include "error.h"
+#include "pixfmt.h"
+#include "stats.h"
+#include "str.h"
+
+
+// beyond these a delta is hardly smaller than a keyframe
+#define DELTA_MAX_RECTS    512
+#define DELTA_MAX_AREA_PCT 60
+
+static void put_be16(uint8_t *const p, const uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put_be32(uint8_t *const p, const uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static encoded_t make_part(const uint8_t type, const int w, const int h, const std::vector<rect_t> & rects, const std::vector<encoded_t> & images)
+{
+	size_t len = 7;
+	for(auto & image: images)
+		len += 12 + image.len;
+
+	uint8_t *out = reinterpret_cast<uint8_t *>(malloc(len));
+	if (!out)
+		error_exit(true, "make_part: cannot allocate %zu bytes", len);
+
+	out[0] = type;
+	put_be16(&out[1], w);
+	put_be16(&out[3], h);
+	put_be16(&out[5], rects.size());
+
+	uint8_t *p = &out[7];
+
+	for(size_t i=0; i<rects.size(); i++) {
+		put_be16(&p[0],  rects[i].x);
+		put_be16(&p[2],  rects[i].y);
+		put_be16(&p[4],  rects[i].w);
+		put_be16(&p[6],  rects[i].h);
+		put_be32(&p[8],  images[i].len);
+		memcpy  (&p[12], images[i].data.get(), images[i].len);
+
+		p += 12 + images[i].len;
+	}
+
+	return make_encoded(out, len);
+}
+
+std::vector<rect_t> find_dirty_rects(frame *const prev, frame *const cur, const int cell_w, const int cell_h)
+{
+	const int      w      = cur->get_width();
+	const int      h      = cur->get_height();
+	const uint8_t *a      = prev->get_pixels(PF_RGB);
+	const uint8_t *b      = cur ->get_pixels(PF_RGB);
+	const int      n_cols = (w + cell_w - 1) / cell_w;
+	const int      n_rows = (h + cell_h - 1) / cell_h;
+
+	std::vector<rect_t> out;
+	std::vector<size_t> open;  // rectangles (index in 'out') that end at the previous cell row
+
+	for(int row=0; row<n_rows; row++) {
+		const int y  = row * cell_h;
+		const int ch = std::min(cell_h, h - y);
+
+		std::vector<bool> dirty(n_cols);
+
+		for(int line=y; line<y + ch; line++) {
+			const size_t offset = size_t(line) * w * 3;
+
+			// most lines did not change at all
+			if (memcmp(&a[offset], &b[offset], w * 3) == 0)
+				continue;
+
+			for(int col=0; col<n_cols; col++) {
+				if (dirty[col])
+					continue;
+
+				const int x  = col * cell_w;
+				const int cw = std::min(cell_w, w - x);
+
+				dirty[col] = memcmp(&a[offset + x * 3], &b[offset + x * 3], cw * 3) != 0;
+			}
+		}
+
+		// a span of dirty cells with the same columns as one in the row
+		// above extends that rectangle
+		std::vector<size_t> still_open;
+
+		for(int col=0; col<n_cols;) {
+			if (dirty[col] == false) {
+				col++;
+				continue;
+			}
+
+			int end = col;
+			while(end < n_cols && dirty[end])
+				end++;
+
+			const rect_t r { col * cell_w, y, std::min(end * cell_w, w) - col * cell_w, ch };
+
+			auto it = std::find_if(open.begin(), open.end(), [&out, &r](const size_t i) { return out[i].x == r.x && out[i].w == r.w; });
+			if (it != open.end()) {
+				out[*it].h += ch;
+				still_open.push_back(*it);
+			}
+			else {
+				still_open.push_back(out.size());
+				out.push_back(r);
+			}
+
+			col = end;
+		}
+
+		open = still_open;
+	}
+
+	return out;
+}
+
+encoded_t make_keyframe(frame *const f, cached_renderer *const renderer, const int level)
+{
+	const std::string encoding = myformat("key-%s-%d", renderer->get_encoder().extension.c_str(), renderer->clamp_level(level));
+
+	return f->get_encoded(encoding, [renderer, level](frame *const f) {
+			// the full frame is shared with the normal streams
+			encoded_t image = renderer->encode(f, level);
+
+			stats.add("delta-keyframes");
+
+			return make_part(DELTA_KEYFRAME, f->get_width(), f->get_height(), { { 0, 0, f->get_width(), f->get_height() } }, { image });
+		});
+}
+
+encoded_t make_delta(frame *const prev, frame *const cur, cached_renderer *const renderer, const int level, const int cell_w, const int cell_h)
+{
+	if (prev->get_width() != cur->get_width() || prev->get_height() != cur->get_height())
+		return make_keyframe(cur, renderer, level);
+
+	const encoder_t & e        = renderer->get_encoder();
+	const std::string encoding = myformat("delta-%s-%d-%" PRIu64, e.extension.c_str(), renderer->clamp_level(level), prev->get_frame_nr());
+
+	return cur->get_encoded(encoding, [prev, renderer, level, cell_w, cell_h, &e](frame *const f) {
+			const int w = f->get_width();
+			const int h = f->get_height();
+
+			// nothing new (a keepalive): no rectangles
+			std::vector<rect_t> rects;
+			if (prev->get_frame_nr() != f->get_frame_nr())
+				rects = find_dirty_rects(prev, f, cell_w, cell_h);
+
+			size_t area = 0;
+			for(auto & r: rects)
+				area += size_t(r.w) * r.h;
+
+			if (rects.size() > DELTA_MAX_RECTS || area * 100 > size_t(w) * h * DELTA_MAX_AREA_PCT)
+				return make_keyframe(f, renderer, level);
+
+			const uint8_t *rgb = f->get_pixels(PF_RGB);
+
+			std::vector<encoded_t> images;
+
+			for(auto & r: rects) {
+				uint8_t *crop = reinterpret_cast<uint8_t *>(malloc(size_t(r.w) * r.h * 3));
+				if (!crop)
+					error_exit(true, "make_delta: cannot allocate %d x %d pixels", r.w, r.h);
+
+				for(int y=0; y<r.h; y++)
+					memcpy(&crop[size_t(y) * r.w * 3], &rgb[(size_t(r.y + y) * w + r.x) * 3], r.w * 3);
+
+				uint8_t *converted = crop;
+				if (e.pf != PF_RGB) {
+					converted = reinterpret_cast<uint8_t *>(malloc(get_pixel_format_size(e.pf, r.w, r.h)));
+					if (!converted)
+						error_exit(true, "make_delta: cannot allocate %d x %d pixels", r.w, r.h);
+
+					convert_rgb_pixels(crop, r.w, r.h, e.pf, converted);
+					free(crop);
+				}
+
+				uint8_t *out     = nullptr;
+				size_t   out_len = 0;
+				e.pw(r.w, r.h, renderer->clamp_level(level), converted, &out, &out_len);
+				free(converted);
+
+				images.push_back(make_encoded(out, out_len));
+			}
+
+			stats.add("delta-parts");
+			stats.add("delta-rects", rects.size());
+
+			return make_part(DELTA_CHANGES, w, h, rects, images);
+		});
+}
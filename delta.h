@@ -0,0 +1,28 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+#include "encoders.h"
+#include "frame.h"
+
+
+// a delta stream part (all numbers big endian):
+//   uint8_t  type (DELTA_KEYFRAME or DELTA_CHANGES)
+//   uint16_t screen width, uint16_t screen height
+//   uint16_t number of rectangles, then for each:
+//     uint16_t x, y, w, h, uint32_t length, an image of w x h (PNG, QOI, ...)
+// a keyframe is one rectangle of the whole screen
+#define DELTA_KEYFRAME 'K'
+#define DELTA_CHANGES  'D'
+
+// the cells that differ between two frames of the same size, merged into
+// rectangles
+std::vector<rect_t> find_dirty_rects(frame *const prev, frame *const cur, const int cell_w, const int cell_h);
+
+encoded_t make_keyframe(frame *const f, cached_renderer *const renderer, const int level);
+
+// what changed since 'prev' (a keyframe when that is cheaper); shared by
+// all clients that received 'prev'
+encoded_t make_delta(frame *const prev, frame *const cur, cached_renderer *const renderer, const int level, const int cell_w, const int cell_h);
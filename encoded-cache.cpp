@@ -0,0 +1,80 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include "encoded-cache.h"
+#include "stats.h"
+#include "str.h"
+
+
+encoded_cache::encoded_cache(const size_t max_size) : max_size(max_size)
+{
+}
+
+encoded_cache::~encoded_cache()
+{
+}
+
+static std::string make_key(const uint64_t content_hash, const std::string & name)
+{
+	return myformat("%016llx/", static_cast<unsigned long long>(content_hash)) + name;
+}
+
+void encoded_cache::update_stats()
+{
+	const uint64_t hits   = stats.get("encoded-cache-hits");
+	const uint64_t misses = stats.get("encoded-cache-misses");
+
+	if (hits + misses)
+		stats.set("encoded-cache-hit-rate-pct", hits * 100 / (hits + misses));
+
+	stats.set("encoded-cache-bytes",   cur_size);
+	stats.set("encoded-cache-entries", lru.size());
+}
+
+std::optional<encoded_t> encoded_cache::get(const uint64_t content_hash, const std::string & name)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = index.find(make_key(content_hash, name));
+
+	if (it == index.end()) {
+		stats.add("encoded-cache-misses");
+		update_stats();
+
+		return { };
+	}
+
+	lru.splice(lru.begin(), lru, it->second);
+
+	stats.add("encoded-cache-hits");
+	update_stats();
+
+	return it->second->second;
+}
+
+void encoded_cache::put(const uint64_t content_hash, const std::string & name, const encoded_t & data)
+{
+	if (data.len > max_size)
+		return;
+
+	const std::string key = make_key(content_hash, name);
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (index.find(key) != index.end())
+		return;
+
+	lru.push_front({ key, data });
+	index.insert({ key, lru.begin() });
+	cur_size += data.len;
+
+	while(cur_size > max_size) {
+		auto & last = lru.back();
+
+		cur_size -= last.second.len;
+		index.erase(last.first);
+		lru.pop_back();
+
+		stats.add("encoded-cache-evictions");
+	}
+
+	update_stats();
+}
@@ -0,0 +1,35 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "frame.h"
+
+
+// encoded images by screen content hash and encoding, so that a screen
+// that was shown before does not need to be encoded again
+class encoded_cache
+{
+private:
+	const size_t max_size { 0 };
+	size_t       cur_size { 0 };
+	std::mutex   lock;
+
+	std::list<std::pair<std::string, encoded_t> > lru;  // most recently used at the front
+	std::unordered_map<std::string, std::list<std::pair<std::string, encoded_t> >::iterator> index;
+
+	void update_stats();
+
+public:
+	encoded_cache(const size_t max_size);
+	virtual ~encoded_cache();
+
+	std::optional<encoded_t> get(const uint64_t content_hash, const std::string & name);
+	void                     put(const uint64_t content_hash, const std::string & name, const encoded_t & data);
+};
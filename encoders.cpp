@@ -0,0 +1,161 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <stdlib.h>
+
+#include "content-encoding.h"
+#include "encoders.h"
+#include "logging.h"
+#include "stats.h"
+#include "str.h"
+
+
+cached_renderer::cached_renderer(const encoder_t & e, encoded_cache *const ec) :
+	e(e), ec(ec)
+{
+	dolog(ll_info, "cached_renderer: instantiated %s encoder", e.extension.c_str());
+}
+
+cached_renderer::~cached_renderer()
+{
+	dolog(ll_info, "cached_renderer: %s encoder no longer in use", e.extension.c_str());
+}
+
+int cached_renderer::clamp_level(const int level) const
+{
+	return std::max(e.level_min, std::min(e.level_max, level));
+}
+
+bool cached_renderer::is_new(const frame *const f)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	bool changed = f->get_frame_nr() != frame_nr;
+	frame_nr     = f->get_frame_nr();
+
+	return changed;
+}
+
+encoded_t cached_renderer::encode(frame *const f, const int level)
+{
+	const std::string encoding = myformat("%s-%d", e.extension.c_str(), clamp_level(level));
+
+	return f->get_encoded(encoding, [this, &encoding, level](frame *const f) {
+			auto cached = ec->get(f->get_content_hash(), encoding);
+			if (cached.has_value())
+				return cached.value();
+
+			uint8_t *out     = nullptr;
+			size_t   out_len = 0;
+			e.pw(f->get_width(), f->get_height(), clamp_level(level), f->get_pixels(e.pf), &out, &out_len);
+
+			encoded_t data = make_encoded(out, out_len);
+			ec->put(f->get_content_hash(), encoding, data);
+
+			stats.add("encodes-" + e.extension);
+
+			return data;
+		});
+}
+
+encoded_t cached_renderer::encode(frame *const f, const int level, const std::string & content_encoding)
+{
+	if (content_encoding.empty())
+		return encode(f, level);
+
+	const std::string encoding = myformat("%s-%d+%s", e.extension.c_str(), clamp_level(level), content_encoding.c_str());
+
+	return f->get_encoded(encoding, [this, &encoding, level, &content_encoding](frame *const f) {
+			auto cached = ec->get(f->get_content_hash(), encoding);
+			if (cached.has_value())
+				return cached.value();
+
+			encoded_t data = compress_content(content_encoding, encode(f, level));
+			ec->put(f->get_content_hash(), encoding, data);
+
+			stats.add("compressions-" + content_encoding);
+
+			return data;
+		});
+}
+
+encoder_registry::encoder_registry()
+{
+}
+
+encoder_registry::~encoder_registry()
+{
+}
+
+void encoder_registry::add(const encoder_t & e)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	encoders.push_back(e);
+}
+
+std::vector<encoder_t> encoder_registry::get_encoders()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return encoders;
+}
+
+std::optional<std::string> encoder_registry::select(const std::string & accept)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	std::optional<std::string> selected;
+	double                     selected_q = 0.;
+
+	// e.g. "image/webp,image/png;q=0.9,*/*;q=0.8"
+	for(auto & element: split(accept, ",")) {
+		auto   parts = split(element, ";");
+		if (parts.empty())
+			continue;
+
+		std::string type = str_tolower(trim(parts.at(0)));
+		double      q    = 1.;
+
+		for(size_t i=1; i<parts.size(); i++) {
+			std::string parameter = trim(parts.at(i));
+
+			if (parameter.substr(0, 2) == "q=")
+				q = atof(parameter.substr(2).c_str());
+		}
+
+		if (q <= selected_q)
+			continue;
+
+		// wildcards select the preferred (first registered) format
+		for(auto & e: encoders) {
+			if (type == e.mime_type || type == "*/*" || type == "image/*") {
+				selected   = e.extension;
+				selected_q = q;
+				break;
+			}
+		}
+	}
+
+	return selected;
+}
+
+std::shared_ptr<cached_renderer> encoder_registry::subscribe(const std::string & extension, encoded_cache *const ec)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = instances.find(extension);
+	if (it != instances.end()) {
+		auto instance = it->second.lock();
+		if (instance)
+			return instance;
+	}
+
+	auto e = std::find_if(encoders.begin(), encoders.end(), [&extension](const encoder_t & e) { return e.extension == extension; });
+	if (e == encoders.end())
+		return nullptr;
+
+	auto instance = std::make_shared<cached_renderer>(*e, ec);
+	instances[extension] = instance;
+
+	return instance;
+}
@@ -0,0 +1,79 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "encoded-cache.h"
+#include "frame.h"
+#include "pixfmt.h"
+
+
+typedef void (*writer)(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
+
+// what an image format offers; registered at startup, instantiated when
+// the first client asks for it
+typedef struct {
+	std::string    extension;  // "jpeg" gives /frame.jpeg and /stream.mjpeg
+	std::string    mime_type;
+	pixel_format_t pf;         // input pixel format of 'pw'
+	int            level_min;  // compression levels this format accepts,
+	int            level_max;  // equal when it cannot be tuned
+	writer         pw;
+	bool           compressible;  // transport compression (zstd, lz4) pays off
+} encoder_t;
+
+// encodes frames in one format for all its clients
+class cached_renderer
+{
+private:
+	const encoder_t  e;
+	encoded_cache   *const ec { nullptr };
+	std::mutex       lock;
+	uint64_t         frame_nr { 0 };
+
+public:
+	cached_renderer(const encoder_t & e, encoded_cache *const ec);
+	virtual ~cached_renderer();
+
+	const encoder_t & get_encoder() const { return e; }
+
+	int       clamp_level(const int level) const;
+
+	// true when 'f' is newer than the frame previously asked for
+	bool      is_new   (const frame *const f);
+
+	// encoded once per frame and level, regardless of the number of
+	// clients, and not at all when this screen was encoded before
+	encoded_t encode   (frame *const f, const int level);
+	// the same, compressed with a Content-Encoding (see content-encoding.h)
+	encoded_t encode   (frame *const f, const int level, const std::string & content_encoding);
+};
+
+class encoder_registry
+{
+private:
+	std::mutex             lock;
+	std::vector<encoder_t> encoders;  // in order of preference
+	std::map<std::string, std::weak_ptr<cached_renderer> > instances;
+
+public:
+	encoder_registry();
+	virtual ~encoder_registry();
+
+	void add(const encoder_t & e);
+
+	std::vector<encoder_t>   get_encoders();
+
+	// picks the extension of the format that fits an Accept-header best
+	std::optional<std::string> select(const std::string & accept);
+
+	// the renderer lives as long as at least one client holds on to it;
+	// nullptr for an unknown extension
+	std::shared_ptr<cached_renderer> subscribe(const std::string & extension, encoded_cache *const ec);
+};
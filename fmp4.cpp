@@ -0,0 +1,262 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <string.h>
+
+#include "fmp4.h"
+
+
+#define TIMESCALE 1000  // ms
+
+static void put_be16(std::vector<uint8_t> *const out, const uint16_t v)
+{
+	out->push_back(v >> 8);
+	out->push_back(v);
+}
+
+static void put_be32(std::vector<uint8_t> *const out, const uint32_t v)
+{
+	out->push_back(v >> 24);
+	out->push_back(v >> 16);
+	out->push_back(v >> 8);
+	out->push_back(v);
+}
+
+static void put_be64(std::vector<uint8_t> *const out, const uint64_t v)
+{
+	put_be32(out, v >> 32);
+	put_be32(out, v);
+}
+
+static void put_zeros(std::vector<uint8_t> *const out, const size_t n)
+{
+	out->insert(out->end(), n, 0);
+}
+
+static void patch_be32(std::vector<uint8_t> *const out, const size_t offset, const uint32_t v)
+{
+	(*out)[offset + 0] = v >> 24;
+	(*out)[offset + 1] = v >> 16;
+	(*out)[offset + 2] = v >> 8;
+	(*out)[offset + 3] = v;
+}
+
+// returns where the box starts, for box_end() to fill in the size
+static size_t box_begin(std::vector<uint8_t> *const out, const char *const type)
+{
+	const size_t start = out->size();
+
+	put_be32(out, 0);
+	out->insert(out->end(), type, type + 4);
+
+	return start;
+}
+
+static size_t full_box_begin(std::vector<uint8_t> *const out, const char *const type, const uint8_t version, const uint32_t flags)
+{
+	const size_t start = box_begin(out, type);
+
+	put_be32(out, (version << 24) | flags);
+
+	return start;
+}
+
+static void box_end(std::vector<uint8_t> *const out, const size_t start)
+{
+	patch_be32(out, start, out->size() - start);
+}
+
+static void put_matrix(std::vector<uint8_t> *const out)
+{
+	const uint32_t unity[] { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+	for(auto v: unity)
+		put_be32(out, v);
+}
+
+fmp4_muxer::fmp4_muxer(const int w, const int h) :
+	w(w), h(h)
+{
+}
+
+fmp4_muxer::~fmp4_muxer()
+{
+}
+
+std::vector<uint8_t> fmp4_muxer::get_init_segment(const std::vector<uint8_t> & sps, const std::vector<uint8_t> & pps)
+{
+	std::vector<uint8_t> out;
+
+	size_t ftyp = box_begin(&out, "ftyp");
+	out.insert(out.end(), { 'i', 's', 'o', '5' });
+	put_be32(&out, 512);  // minor version
+	for(auto brand: { "iso5", "iso6", "avc1", "mp41" })
+		out.insert(out.end(), brand, brand + 4);
+	box_end(&out, ftyp);
+
+	size_t moov = box_begin(&out, "moov");
+
+	size_t mvhd = full_box_begin(&out, "mvhd", 0, 0);
+	put_zeros(&out, 8);  // creation, modification time
+	put_be32(&out, TIMESCALE);
+	put_be32(&out, 0);  // duration: not known
+	put_be32(&out, 0x00010000);  // rate 1.0
+	put_be16(&out, 0x0100);  // volume 1.0
+	put_zeros(&out, 2 + 8);
+	put_matrix(&out);
+	put_zeros(&out, 6 * 4);
+	put_be32(&out, 2);  // next track id
+	box_end(&out, mvhd);
+
+	size_t trak = box_begin(&out, "trak");
+
+	size_t tkhd = full_box_begin(&out, "tkhd", 0, 3);  // enabled, in movie
+	put_zeros(&out, 8);
+	put_be32(&out, 1);  // track id
+	put_zeros(&out, 4 + 4 + 8);  // reserved, duration, reserved
+	put_zeros(&out, 2 + 2 + 2 + 2);  // layer, alternate group, volume, reserved
+	put_matrix(&out);
+	put_be32(&out, w << 16);
+	put_be32(&out, h << 16);
+	box_end(&out, tkhd);
+
+	size_t mdia = box_begin(&out, "mdia");
+
+	size_t mdhd = full_box_begin(&out, "mdhd", 0, 0);
+	put_zeros(&out, 8);
+	put_be32(&out, TIMESCALE);
+	put_be32(&out, 0);
+	put_be16(&out, 0x55c4);  // "und"
+	put_be16(&out, 0);
+	box_end(&out, mdhd);
+
+	size_t hdlr = full_box_begin(&out, "hdlr", 0, 0);
+	put_be32(&out, 0);
+	out.insert(out.end(), { 'v', 'i', 'd', 'e' });
+	put_zeros(&out, 3 * 4);
+	const char name[] = "TermCamNG";
+	out.insert(out.end(), name, name + sizeof name);
+	box_end(&out, hdlr);
+
+	size_t minf = box_begin(&out, "minf");
+
+	size_t vmhd = full_box_begin(&out, "vmhd", 0, 1);
+	put_zeros(&out, 2 + 3 * 2);
+	box_end(&out, vmhd);
+
+	size_t dinf = box_begin(&out, "dinf");
+	size_t dref = full_box_begin(&out, "dref", 0, 0);
+	put_be32(&out, 1);
+	box_end(&out, full_box_begin(&out, "url ", 0, 1));  // in this file
+	box_end(&out, dref);
+	box_end(&out, dinf);
+
+	size_t stbl = box_begin(&out, "stbl");
+
+	size_t stsd = full_box_begin(&out, "stsd", 0, 0);
+	put_be32(&out, 1);
+
+	size_t avc1 = box_begin(&out, "avc1");
+	put_zeros(&out, 6);
+	put_be16(&out, 1);  // data reference index
+	put_zeros(&out, 2 + 2 + 3 * 4);
+	put_be16(&out, w);
+	put_be16(&out, h);
+	put_be32(&out, 0x00480000);  // 72 dpi
+	put_be32(&out, 0x00480000);
+	put_be32(&out, 0);
+	put_be16(&out, 1);  // frames per sample
+	put_zeros(&out, 32);  // compressor name
+	put_be16(&out, 0x0018);  // depth
+	put_be16(&out, 0xffff);
+
+	size_t avcc = box_begin(&out, "avcC");
+	out.push_back(1);  // version
+	out.push_back(sps.at(1));  // profile
+	out.push_back(sps.at(2));  // compatibility
+	out.push_back(sps.at(3));  // level
+	out.push_back(0xff);  // 4 byte NAL lengths
+	out.push_back(0xe1);  // 1 SPS
+	put_be16(&out, sps.size());
+	out.insert(out.end(), sps.begin(), sps.end());
+	out.push_back(1);  // 1 PPS
+	put_be16(&out, pps.size());
+	out.insert(out.end(), pps.begin(), pps.end());
+
+	// high profiles: 4:2:0, 8 bit
+	if (sps.at(1) == 100 || sps.at(1) == 110 || sps.at(1) == 122 || sps.at(1) == 144)
+		out.insert(out.end(), { 0xfd, 0xf8, 0xf8, 0x00 });
+
+	box_end(&out, avcc);
+	box_end(&out, avc1);
+	box_end(&out, stsd);
+
+	// the samples are in the fragments
+	for(auto type: { "stts", "stsc", "stco" }) {
+		size_t box = full_box_begin(&out, type, 0, 0);
+		put_be32(&out, 0);
+		box_end(&out, box);
+	}
+
+	size_t stsz = full_box_begin(&out, "stsz", 0, 0);
+	put_be32(&out, 0);
+	put_be32(&out, 0);
+	box_end(&out, stsz);
+
+	box_end(&out, stbl);
+	box_end(&out, minf);
+	box_end(&out, mdia);
+	box_end(&out, trak);
+
+	size_t mvex = box_begin(&out, "mvex");
+	size_t trex = full_box_begin(&out, "trex", 0, 0);
+	put_be32(&out, 1);  // track id
+	put_be32(&out, 1);  // sample description index
+	put_zeros(&out, 3 * 4);  // duration, size, flags
+	box_end(&out, trex);
+	box_end(&out, mvex);
+
+	box_end(&out, moov);
+
+	return out;
+}
+
+std::vector<uint8_t> fmp4_muxer::get_fragment(const uint8_t *const access_unit, const size_t len, const bool keyframe, const uint64_t decode_time, const uint32_t duration)
+{
+	std::vector<uint8_t> out;
+
+	size_t moof = box_begin(&out, "moof");
+
+	size_t mfhd = full_box_begin(&out, "mfhd", 0, 0);
+	put_be32(&out, ++sequence_nr);
+	box_end(&out, mfhd);
+
+	size_t traf = box_begin(&out, "traf");
+
+	size_t tfhd = full_box_begin(&out, "tfhd", 0, 0x020000);  // default base is moof
+	put_be32(&out, 1);
+	box_end(&out, tfhd);
+
+	size_t tfdt = full_box_begin(&out, "tfdt", 1, 0);
+	put_be64(&out, decode_time);
+	box_end(&out, tfdt);
+
+	// data offset, sample duration, size and flags present
+	size_t trun = full_box_begin(&out, "trun", 0, 0x000701);
+	put_be32(&out, 1);  // sample count
+	size_t data_offset = out.size();
+	put_be32(&out, 0);
+	put_be32(&out, duration);
+	put_be32(&out, len);
+	put_be32(&out, keyframe ? 0x02000000 : 0x01010000);  // depends on nothing / non-sync
+	box_end(&out, trun);
+
+	box_end(&out, traf);
+	box_end(&out, moof);
+
+	patch_be32(&out, data_offset, out.size() + 8);  // the data follows the mdat header
+
+	put_be32(&out, 8 + len);
+	out.insert(out.end(), { 'm', 'd', 'a', 't' });
+	out.insert(out.end(), access_unit, access_unit + len);
+
+	return out;
+}
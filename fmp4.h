@@ -0,0 +1,29 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+
+// fragmented MP4 (ISO BMFF) with one H.264 track, which a <video> tag
+// plays while it is being received: an init segment, then a fragment
+// (moof + mdat) per frame; times are in milliseconds
+class fmp4_muxer
+{
+private:
+	const int w           { 0 };
+	const int h           { 0 };
+	uint32_t  sequence_nr { 0 };
+
+public:
+	fmp4_muxer(const int w, const int h);
+	virtual ~fmp4_muxer();
+
+	// ftyp + moov; 'sps' and 'pps' without start code or length
+	std::vector<uint8_t> get_init_segment(const std::vector<uint8_t> & sps, const std::vector<uint8_t> & pps);
+
+	// 'access_unit' are the NAL units of one frame, each preceded by its
+	// length (4 bytes, big endian)
+	std::vector<uint8_t> get_fragment(const uint8_t *const access_unit, const size_t len, const bool keyframe, const uint64_t decode_time, const uint32_t duration);
+};
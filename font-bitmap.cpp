@@ -0,0 +1,333 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "error.h"
+#include "font-bitmap.h"
+#include "logging.h"
+#include "str.h"
+
+
+// byte -> 8 pixels, each 0 (background) or 1 (foreground)
+static const struct bit_expansion_table {
+	uint8_t v[256][8];
+
+	bit_expansion_table() {
+		for(int b=0; b<256; b++) {
+			for(int k=0; k<8; k++)
+				v[b][k] = (b >> (7 - k)) & 1;
+		}
+	}
+} bit_expansion;
+
+static uint32_t get_le32(const std::vector<uint8_t> & data, const size_t offset)
+{
+	if (offset + 4 > data.size())
+		error_exit(false, "font_bitmap: font file truncated");
+
+	return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (uint32_t(data[offset + 3]) << 24);
+}
+
+font_bitmap::font_bitmap(const std::string & font_file)
+{
+	// gzread also reads uncompressed files
+	gzFile fh = gzopen(font_file.c_str(), "rb");
+	if (!fh)
+		error_exit(true, "cannot open font file %s", font_file.c_str());
+
+	std::vector<uint8_t> data;
+
+	for(;;) {
+		uint8_t buffer[65536];
+		int     rc = gzread(fh, buffer, sizeof buffer);
+		if (rc <= 0)
+			break;
+
+		data.insert(data.end(), buffer, buffer + rc);
+	}
+
+	gzclose(fh);
+
+	if (data.size() >= 4 && data[0] == 0x72 && data[1] == 0xb5 && data[2] == 0x4a && data[3] == 0x86)
+		load_psf2(data);
+	else if (data.size() >= 4 && data[0] == 0x36 && data[1] == 0x04)
+		load_psf1(data);
+	else if (data.size() >= 9 && memcmp(data.data(), "STARTFONT", 9) == 0)
+		load_bdf(data);
+	else
+		error_exit(false, "font file %s is not a PSF or BDF file", font_file.c_str());
+
+	if (font_width <= 0 || font_height <= 0 || glyphs.empty())
+		error_exit(false, "font file %s contains no usable glyphs", font_file.c_str());
+
+	dolog(ll_info, "font_bitmap: %zu glyphs of %dx%d loaded from %s", glyphs.size() / (font_height * bytes_per_row), font_width, font_height, font_file.c_str());
+}
+
+font_bitmap::~font_bitmap()
+{
+}
+
+void font_bitmap::load_psf1(const std::vector<uint8_t> & data)
+{
+	const uint8_t mode      = data[2];
+	const int     char_size = data[3];
+	const size_t  n_glyphs  = mode & 1 ? 512 : 256;
+
+	font_width    = 8;
+	font_height   = char_size;
+	bytes_per_row = 1;
+
+	if (4 + n_glyphs * char_size > data.size())
+		error_exit(false, "font_bitmap: PSF1 font file truncated");
+
+	glyphs.assign(data.begin() + 4, data.begin() + 4 + n_glyphs * char_size);
+
+	if ((mode & 6) == 0) {  // no unicode table
+		for(size_t i=0; i<n_glyphs; i++)
+			unicode_map.insert({ UChar32(i), uint32_t(i) });
+
+		return;
+	}
+
+	size_t offset = 4 + n_glyphs * char_size;
+
+	for(size_t i=0; i<n_glyphs && offset + 1 < data.size(); i++) {
+		bool sequence = false;
+
+		while(offset + 1 < data.size()) {
+			uint16_t v = data[offset] | (data[offset + 1] << 8);
+			offset += 2;
+
+			if (v == 0xffff)
+				break;
+
+			if (v == 0xfffe)  // combining sequences are not supported
+				sequence = true;
+			else if (!sequence)
+				unicode_map.insert({ v, uint32_t(i) });
+		}
+	}
+}
+
+void font_bitmap::load_psf2(const std::vector<uint8_t> & data)
+{
+	const uint32_t header_size = get_le32(data, 8);
+	const uint32_t flags       = get_le32(data, 12);
+	const uint32_t n_glyphs    = get_le32(data, 16);
+	const uint32_t char_size   = get_le32(data, 20);
+
+	font_height   = get_le32(data, 24);
+	font_width    = get_le32(data, 28);
+	bytes_per_row = (font_width + 7) / 8;
+
+	if (char_size != uint32_t(font_height * bytes_per_row))
+		error_exit(false, "font_bitmap: PSF2 glyph size (%u) does not match dimensions (%dx%d)", char_size, font_width, font_height);
+
+	if (header_size + size_t(n_glyphs) * char_size > data.size())
+		error_exit(false, "font_bitmap: PSF2 font file truncated");
+
+	glyphs.assign(data.begin() + header_size, data.begin() + header_size + size_t(n_glyphs) * char_size);
+
+	if ((flags & 1) == 0) {  // no unicode table
+		for(uint32_t i=0; i<n_glyphs; i++)
+			unicode_map.insert({ UChar32(i), i });
+
+		return;
+	}
+
+	size_t offset = header_size + size_t(n_glyphs) * char_size;
+
+	for(uint32_t i=0; i<n_glyphs && offset < data.size(); i++) {
+		bool sequence = false;
+
+		while(offset < data.size()) {
+			uint8_t b = data[offset++];
+
+			if (b == 0xff)
+				break;
+
+			if (b == 0xfe) {  // combining sequences are not supported
+				sequence = true;
+				continue;
+			}
+
+			// utf-8
+			UChar32 c      = b;
+			int     n_more = 0;
+
+			if ((b & 0xe0) == 0xc0)
+				c = b & 31, n_more = 1;
+			else if ((b & 0xf0) == 0xe0)
+				c = b & 15, n_more = 2;
+			else if ((b & 0xf8) == 0xf0)
+				c = b & 7, n_more = 3;
+
+			for(int k=0; k<n_more && offset < data.size(); k++)
+				c = (c << 6) | (data[offset++] & 63);
+
+			if (!sequence)
+				unicode_map.insert({ c, i });
+		}
+	}
+}
+
+// std::stoi throws on garbage; report that like the other configuration errors
+static int bdf_int(const std::string & value, const size_t line_nr, const int base = 10)
+{
+	try {
+		return std::stoi(value, nullptr, base);
+	}
+	catch(const std::invalid_argument & e) {
+		throw myformat("font_bitmap: BDF line %zu: \"%s\" is not a valid number", line_nr, value.c_str());
+	}
+	catch(const std::out_of_range & e) {
+		throw myformat("font_bitmap: BDF line %zu: \"%s\" is out of range", line_nr, value.c_str());
+	}
+}
+
+void font_bitmap::load_bdf(const std::vector<uint8_t> & data)
+{
+	auto lines = split(std::string(reinterpret_cast<const char *>(data.data()), data.size()), "\n");
+
+	int  fbb_w   = 0;
+	int  fbb_h   = 0;
+	int  fbb_xo  = 0;
+	int  fbb_yo  = 0;
+
+	int  encoding= -1;
+	int  bbx_w   = 0;
+	int  bbx_h   = 0;
+	int  bbx_xo  = 0;
+	int  bbx_yo  = 0;
+	int  row     = -1;  // >= 0 while in a BITMAP section
+	size_t glyph_offset = 0;
+
+	size_t line_nr = 0;
+
+	for(auto & line_in : lines) {
+		line_nr++;
+
+		std::string line = line_in;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		auto parts = split(line, " ");
+		if (parts.empty())
+			continue;
+
+		if (row >= 0) {
+			if (parts[0] == "ENDCHAR") {
+				row = -1;
+				continue;
+			}
+
+			if (encoding >= 0) {
+				int dest_y = (fbb_h + fbb_yo) - (bbx_h + bbx_yo) + row;
+				int dest_x = bbx_xo - fbb_xo;
+
+				for(size_t nibble=0; nibble<line.size(); nibble++) {
+					int v = bdf_int(line.substr(nibble, 1), line_nr, 16);
+
+					for(int bit=0; bit<4; bit++) {
+						int x = dest_x + int(nibble) * 4 + bit;
+
+						if ((v & (8 >> bit)) && x >= 0 && x < font_width && dest_y >= 0 && dest_y < font_height && int(nibble) * 4 + bit < bbx_w)
+							glyphs[glyph_offset + dest_y * bytes_per_row + x / 8] |= 128 >> (x & 7);
+					}
+				}
+			}
+
+			row++;
+		}
+		else if (parts[0] == "FONTBOUNDINGBOX" && parts.size() == 5) {
+			fbb_w  = bdf_int(parts[1], line_nr);
+			fbb_h  = bdf_int(parts[2], line_nr);
+			fbb_xo = bdf_int(parts[3], line_nr);
+			fbb_yo = bdf_int(parts[4], line_nr);
+
+			if (fbb_w <= 0 || fbb_h <= 0)
+				throw myformat("font_bitmap: BDF line %zu: FONTBOUNDINGBOX %dx%d is not valid", line_nr, fbb_w, fbb_h);
+
+			font_width    = fbb_w;
+			font_height   = fbb_h;
+			bytes_per_row = (font_width + 7) / 8;
+		}
+		else if (parts[0] == "ENCODING" && parts.size() >= 2)
+			encoding = bdf_int(parts[1], line_nr);
+		else if (parts[0] == "BBX" && parts.size() == 5) {
+			bbx_w  = bdf_int(parts[1], line_nr);
+			bbx_h  = bdf_int(parts[2], line_nr);
+			bbx_xo = bdf_int(parts[3], line_nr);
+			bbx_yo = bdf_int(parts[4], line_nr);
+		}
+		else if (parts[0] == "BITMAP") {
+			if (bytes_per_row == 0)
+				error_exit(false, "font_bitmap: BDF file without FONTBOUNDINGBOX");
+
+			row = 0;
+
+			if (encoding >= 0) {
+				glyph_offset = glyphs.size();
+				glyphs.resize(glyphs.size() + font_height * bytes_per_row);
+
+				unicode_map.insert({ encoding, uint32_t(glyph_offset / (font_height * bytes_per_row)) });
+			}
+		}
+		else if (parts[0] == "STARTCHAR")
+			encoding = -1;
+	}
+}
+
+bool font_bitmap::draw_glyph(const UChar32 utf_character, const intensity_t intensity, const bool invert, const bool underline, const bool strikethrough, const bool italic, const rgb_t & fg, const rgb_t & bg, const int x, const int y, uint8_t *const dest, const int dest_width, const int dest_height)
+{
+	// characters the font does not have become U+FFFD or '?', else only
+	// the background is drawn
+	auto it = unicode_map.find(utf_character);
+	if (it == unicode_map.end())
+		it = unicode_map.find(0xfffd);
+	if (it == unicode_map.end())
+		it = unicode_map.find('?');
+
+	const uint8_t *const glyph = it == unicode_map.end() ? nullptr : &glyphs[size_t(it->second) * font_height * bytes_per_row];
+
+	const int max = get_intensity_multiplier(intensity);
+
+	uint8_t colors[2][3] {
+		{ uint8_t((bg.r * max) >> 8), uint8_t((bg.g * max) >> 8), uint8_t((bg.b * max) >> 8) },
+		{ uint8_t((fg.r * max) >> 8), uint8_t((fg.g * max) >> 8), uint8_t((fg.b * max) >> 8) }
+	};
+
+	if (invert) {
+		for(int i=0; i<3; i++)
+			std::swap(colors[0][i], colors[1][i]);
+	}
+
+	// italic is not available for bitmap fonts
+	const int underline_row     = underline     ? font_height - 2 : -1;
+	const int strikethrough_row = strikethrough ? font_height / 2 : -1;
+	const int use_height        = std::min(font_height, dest_height - y);
+	const int use_width         = std::min(font_width,  dest_width  - x);
+
+	for(int row=0; row<use_height; row++) {
+		uint8_t       *out     = &dest[((y + row) * dest_width + x) * 3];
+		const uint8_t *in      = glyph ? &glyph[row * bytes_per_row] : nullptr;
+		const bool     line    = row == underline_row || row == strikethrough_row;
+		int            n_left  = use_width;
+
+		for(int byte_nr=0; byte_nr<bytes_per_row && n_left > 0; byte_nr++) {
+			const uint8_t *const bits = bit_expansion.v[line ? 255 : (in ? in[byte_nr] : 0)];
+			const int            n    = std::min(8, n_left);
+
+			for(int k=0; k<n; k++, out += 3)
+				memcpy(out, colors[bits[k]], 3);
+
+			n_left -= n;
+		}
+	}
+
+	return true;
+}
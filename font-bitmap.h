@@ -0,0 +1,29 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "font.h"
+
+
+// console bitmap fonts (PSF1, PSF2 and BDF), no anti-aliasing, no scaling
+class font_bitmap : public font
+{
+private:
+	int                  bytes_per_row { 0 };
+	std::vector<uint8_t> glyphs;  // 1 bit per pixel, font_height rows per glyph
+	std::unordered_map<UChar32, uint32_t> unicode_map;
+
+	void load_psf1(const std::vector<uint8_t> & data);
+	void load_psf2(const std::vector<uint8_t> & data);
+	void load_bdf (const std::vector<uint8_t> & data);
+
+public:
+	font_bitmap(const std::string & font_file);
+	virtual ~font_bitmap();
+
+	bool draw_glyph(const UChar32 utf_character, const intensity_t i, const bool invert, const bool underline, const bool strikethrough, const bool italic, const rgb_t & fg, const rgb_t & bg, const int x, const int y, uint8_t *const dest, const int dest_width, const int dest_height) override;
+};
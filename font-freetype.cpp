@@ -0,0 +1,491 @@
+// (C) 2017-2026 by folkert van heusden, released under MIT license
+#include <cassert>
+#include <mutex>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fontconfig/fontconfig.h>
+#include <freetype/ftbitmap.h>
+#include <freetype/ftglyph.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "blit-kernel.h"
+#include "boxdrawing.h"
+#include "error.h"
+#include "font-freetype.h"
+#include "logging.h"
+#include "str.h"
+
+
+FT_Library font_freetype::library;
+
+std::mutex freetype2_lock;
+std::mutex fontconfig_lock;
+
+font_freetype::font_freetype(const std::vector<std::string> & font_files, std::optional<int> font_width_in, const int font_height_in) :
+	char_size_width(font_width_in),
+	char_size_height(font_height_in)
+{
+	FT_Init_FreeType(&font_freetype::library);
+
+	// freetype2 is not thread safe
+	const std::lock_guard<std::mutex> lock(freetype2_lock);
+
+	for(auto & font_file : font_files) {
+		FT_Face face { 0 };
+
+		int rc = FT_New_Face(library, font_file.c_str(), 0, &face);
+		if (rc)
+			error_exit(false, "cannot open font file %s: %x", font_file.c_str(), rc);
+
+		setup_face(face);
+
+		faces.push_back(face);
+	}
+
+	n_configured_faces = faces.size();
+
+	glyph_cache.resize(faces.size());
+	glyph_cache_italic.resize(faces.size());
+
+	// font '0' (first font) must contain all basic characters
+	// determine dimensions of character set
+	int temp_width    = 0;
+	int max_descender = 0;
+	for(UChar32 c = 33; c < 127; c++) {
+		int glyph_index = FT_Get_Char_Index(faces.at(0), c);
+
+		if (FT_Load_Glyph(faces.at(0), glyph_index, FT_LOAD_NO_BITMAP | FT_LOAD_COLOR) == 0) {
+			auto face = faces.at(0);
+			temp_width    = std::max(temp_width, int(face->glyph->metrics.horiAdvance) / 64);  // width should be all the same!
+			max_ascender  = std::max(max_ascender, int(face->glyph->metrics.horiBearingY));
+			max_descender = std::max(max_descender, int(face->glyph->metrics.height - face->glyph->metrics.horiBearingY));
+		}
+	}
+
+	font_height = (max_ascender + max_descender) / 64;
+
+	if (font_width_in.has_value() == false)
+		font_width = temp_width;
+	else
+		font_width = font_width_in.value();
+}
+
+font_freetype::~font_freetype()
+{
+	const std::lock_guard<std::mutex> lock(freetype2_lock);
+
+	for(auto & face: glyph_cache) {
+		for(auto & element: face)
+			FT_Bitmap_Done(library, &element.second.bitmap);
+	}
+
+	for(auto & face: glyph_cache_italic) {
+		for(auto & element: face)
+			FT_Bitmap_Done(library, &element.second.bitmap);
+	}
+
+	for(auto & element: procedural_cache)
+		delete [] element.second.bitmap.buffer;
+
+	for(auto f : faces)
+		FT_Done_Face(f);
+
+	for(auto & m: mapped_files)
+		munmap(m.first, m.second);
+
+	FT_Done_FreeType(font_freetype::library);
+}
+
+void font_freetype::setup_face(FT_Face face)
+{
+	FT_Select_Charmap(face, ft_encoding_unicode);
+
+	if (FT_Set_Char_Size(face, char_size_width.has_value() ? char_size_width.value() * 64 : 0, char_size_height * 64, 72, 72))
+		FT_Select_Size(face, 0);
+}
+
+// ask fontconfig for a font that covers 'c'; freetype2_lock must be held
+std::optional<size_t> font_freetype::load_fallback_face(const UChar32 c)
+{
+	std::string file;
+	int         index = 0;
+
+	{
+		const std::lock_guard<std::mutex> lock(fontconfig_lock);
+
+		FcPattern *pattern = FcPatternCreate();
+		FcCharSet *charset = FcCharSetCreate();
+		FcCharSetAddChar(charset, c);
+		FcPatternAddCharSet(pattern, FC_CHARSET, charset);
+		FcPatternAddString(pattern, FC_FAMILY, reinterpret_cast<const FcChar8 *>("monospace"));
+		FcConfigSubstitute(nullptr, pattern, FcMatchPattern);
+		FcDefaultSubstitute(pattern);
+
+		// FcFontMatch does not weigh the charset enough, so walk the sorted list
+		FcResult   result = FcResultNoMatch;
+		FcFontSet *set    = FcFontSort(nullptr, pattern, FcTrue, nullptr, &result);
+
+		for(int i=0; set && i<set->nfont && file.empty(); i++) {
+			FcCharSet *match_charset = nullptr;
+			FcChar8   *match_file    = nullptr;
+
+			if (FcPatternGetCharSet(set->fonts[i], FC_CHARSET, 0, &match_charset) == FcResultMatch && FcCharSetHasChar(match_charset, c) &&
+			    FcPatternGetString(set->fonts[i], FC_FILE, 0, &match_file) == FcResultMatch) {
+				file = reinterpret_cast<const char *>(match_file);
+
+				FcPatternGetInteger(set->fonts[i], FC_INDEX, 0, &index);
+			}
+		}
+
+		if (set)
+			FcFontSetDestroy(set);
+
+		FcCharSetDestroy(charset);
+		FcPatternDestroy(pattern);
+	}
+
+	if (file.empty())
+		return { };
+
+	std::string key = myformat("%s:%d", file.c_str(), index);
+
+	auto it = fallback_files.find(key);
+	if (it != fallback_files.end())
+		return it->second;
+
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd == -1) {
+		dolog(ll_warning, "font_freetype::load_fallback_face: cannot open %s", file.c_str());
+		return { };
+	}
+
+	struct stat st { };
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (p == MAP_FAILED) {
+		dolog(ll_warning, "font_freetype::load_fallback_face: cannot map %s", file.c_str());
+		return { };
+	}
+
+	FT_Face face { 0 };
+	int rc = FT_New_Memory_Face(library, reinterpret_cast<const FT_Byte *>(p), st.st_size, index, &face);
+	if (rc) {
+		dolog(ll_warning, "font_freetype::load_fallback_face: cannot open font file %s: %x", file.c_str(), rc);
+		munmap(p, st.st_size);
+		// also remember failures, no use retrying these
+		fallback_files.insert({ key, { } });
+		return { };
+	}
+
+	setup_face(face);
+
+	mapped_files.push_back({ p, st.st_size });
+
+	size_t nr = faces.size();
+	faces.push_back(face);
+	glyph_cache.resize(faces.size());
+	glyph_cache_italic.resize(faces.size());
+
+	fallback_files.insert({ key, nr });
+
+	dolog(ll_info, "font_freetype::load_fallback_face: using %s for U+%04X", file.c_str(), c);
+
+	return nr;
+}
+
+// freetype2_lock must be held
+glyph_resolution_t font_freetype::resolve_character(const UChar32 c)
+{
+	auto it = resolution_cache.find(c);
+	if (it != resolution_cache.end())
+		return it->second;
+
+	std::vector<FT_Encoding> encodings { ft_encoding_symbol, ft_encoding_unicode };
+
+	std::optional<glyph_resolution_t> resolution;
+
+	for(auto & encoding : encodings) {
+		for(size_t face = 0; face<faces.size() && resolution.has_value() == false; face++) {
+			FT_Select_Charmap(faces.at(face), encoding);
+
+			FT_UInt glyph_index = FT_Get_Char_Index(faces.at(face), c);
+			if (glyph_index)
+				resolution = { face, glyph_index };
+
+			FT_Select_Charmap(faces.at(face), ft_encoding_unicode);
+		}
+	}
+
+	if (resolution.has_value() == false) {
+		auto fallback = load_fallback_face(c);
+
+		if (fallback.has_value()) {
+			FT_UInt glyph_index = FT_Get_Char_Index(faces.at(fallback.value()), c);
+			if (glyph_index)
+				resolution = { fallback.value(), glyph_index };
+		}
+	}
+
+	// nothing has it: show the "missing glyph" of the last configured font
+	if (resolution.has_value() == false)
+		resolution = { n_configured_faces - 1, 0 };
+
+	resolution_cache.insert({ c, resolution.value() });
+
+	return resolution.value();
+}
+
+void font_freetype::draw_glyph_bitmap_low(const FT_Bitmap *const bitmap, const rgb_t & fg, const rgb_t & bg, const bool has_color, const intensity_t intensity, const bool invert, const bool underline, const bool strikethrough, uint8_t **const result, int *const result_width, int *const result_height)
+{
+	int mode_index = -1;
+
+	if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO)
+		mode_index = 0;
+	else if (bitmap->pixel_mode == FT_PIXEL_MODE_GRAY)
+		mode_index = 1;
+	else if (bitmap->pixel_mode == FT_PIXEL_MODE_LCD)
+		mode_index = 2;
+	else if (bitmap->pixel_mode == FT_PIXEL_MODE_BGRA)
+		mode_index = 3;
+	else {
+		if (render_mode_error == false) {
+			render_mode_error = true;
+
+			dolog(ll_error, "PIXEL MODE %d NOT IMPLEMENTED", bitmap->pixel_mode);
+		}
+
+		return;
+	}
+
+	const int max = get_intensity_multiplier(intensity);
+
+	blit_parameters_t p { };
+	p.fg                = fg;
+	p.bg                = bg;
+	p.max               = max;
+	p.max1              = max - 1;
+	p.underline_row     = underline     ? int(bitmap->rows) - 2 : -1;
+	p.strikethrough_row = strikethrough ? int(bitmap->rows) / 2 : -1;
+	p.line[0]           = (max * fg.r) >> 8;
+	p.line[1]           = (max * fg.g) >> 8;
+	p.line[2]           = (max * fg.b) >> 8;
+
+	*result_height = bitmap->rows;
+	*result_width  = bitmap->pixel_mode == FT_PIXEL_MODE_LCD ? bitmap->width / 3 : bitmap->width;
+	*result        = new uint8_t[*result_width * *result_height * 3];  // the kernels write every pixel
+
+	blit_kernels[mode_index][invert][has_color][underline || strikethrough](bitmap, p, *result, *result_width);
+}
+
+typedef struct {
+        int n;
+        double r, g, b;
+} pixel_t;
+
+void font_freetype::draw_glyph_bitmap(const glyph_cache_entry_t *const glyph, const FT_Int dest_x, const FT_Int dest_y, const rgb_t & fg, const rgb_t & bg, const bool has_color, const intensity_t intensity, const bool invert, const bool underline, const bool strikethrough, uint8_t *const dest, const int dest_width, const int dest_height)
+{
+	uint8_t *result        = nullptr;
+	int      result_width  = 0;
+	int      result_height = 0;
+	draw_glyph_bitmap_low(&glyph->bitmap, fg, bg, has_color, intensity, invert, underline, strikethrough, &result, &result_width, &result_height);
+
+	// resize & copy to x, y
+	if (result_width + glyph->horiBearingX / 64 > font_width || result_height > font_height) {
+		const double x_scale_temp      =        font_width   / (result_width + glyph->horiBearingX / 64.);
+		const double y_scale_temp      = double(font_height) / result_height;
+		const double smallest_scale    = std::min(x_scale_temp, y_scale_temp);
+		const double scaled_bearing    = glyph->horiBearingX / 64 * smallest_scale;
+		const double scaled_bitmap_top = glyph->bitmap_top        * smallest_scale;
+
+		pixel_t *work = new pixel_t[font_width * font_height]();
+
+		for(int y=0; y<result_height; y++) {
+			int target_y     = y * smallest_scale;
+			int put_offset_y = target_y * font_width;
+			int get_offset_y = y * result_width * 3;
+
+			for(int x=0; x<result_width; x++) {
+				int target_x   = x * smallest_scale;
+				int put_offset = put_offset_y + target_x;
+				int get_offset = get_offset_y + x * 3;
+
+				work[put_offset].n++;
+				work[put_offset].r += result[get_offset + 0];
+				work[put_offset].g += result[get_offset + 1];
+				work[put_offset].b += result[get_offset + 2];
+			}
+		}
+
+		// TODO: check for out of bounds writes (x)
+		int work_dest_y = dest_y + max_ascender / 64.0 - scaled_bitmap_top;
+		int use_height  = std::min(dest_height - work_dest_y, font_height);
+
+		memset(dest, 0x00, font_width * use_height * 3);
+		for(int y=0; y<use_height; y++) {
+			int yo  = y * font_width;
+			int temp = y + work_dest_y;
+			if (temp < 0)
+				continue;
+			int o   = temp * dest_width * 3 + (dest_x + scaled_bearing) * 3;
+
+			for(int x=0, i = yo; x<font_width; x++, i++, o += 3) {
+				if (work[i].n) {
+					dest[o + 0] = work[i].r / work[i].n;
+					dest[o + 1] = work[i].g / work[i].n;
+					dest[o + 2] = work[i].b / work[i].n;
+				}
+			}
+		}
+
+		delete [] work;
+	}
+	else {
+		int work_dest_x = dest_x + glyph->horiBearingX / 64;
+		int use_width   = std::min(dest_width  - work_dest_x, result_width);
+		int work_dest_y = dest_y + max_ascender / 64.0 - glyph->bitmap_top;
+		int use_height  = std::min(dest_height - work_dest_y, result_height);
+
+		for(int y=0; y<use_height; y++) {
+			int temp = work_dest_y + y;
+			if (temp >= 0)
+				memcpy(&dest[temp * dest_width * 3 + work_dest_x * 3], &result[result_width * y * 3], use_width * 3);
+		}
+	}
+
+	delete [] result;
+}
+
+// freetype2_lock must be held
+const glyph_cache_entry_t * font_freetype::get_procedural_glyph(const UChar32 c)
+{
+	auto it = procedural_cache.find(c);
+	if (it != procedural_cache.end())
+		return &it->second;
+
+	glyph_cache_entry_t entry { };
+	entry.bitmap.rows       = font_height;
+	entry.bitmap.width      = font_width;
+	entry.bitmap.pitch      = font_width;
+	entry.bitmap.num_grays  = 256;
+	entry.bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+	entry.bitmap.buffer     = new unsigned char[font_width * font_height];
+	entry.horiBearingX      = 0;
+	entry.bitmap_top        = max_ascender / 64;  // top of the cell
+
+	if (render_box_drawing(c, font_width, font_height, entry.bitmap.buffer) == false) {
+		delete [] entry.bitmap.buffer;
+		return nullptr;
+	}
+
+	return &procedural_cache.insert({ c, entry }).first->second;
+}
+
+// freetype2_lock must be held
+const glyph_cache_entry_t * font_freetype::get_freetype_glyph(const UChar32 c, const bool italic, bool *const has_color)
+{
+	glyph_resolution_t resolution = resolve_character(c);
+	const size_t       face       = resolution.face;
+	const FT_UInt      glyph_index= resolution.glyph_index;
+
+	auto & cache = italic ? glyph_cache_italic.at(face) : glyph_cache.at(face);
+
+	auto it = cache.find(glyph_index);
+
+	for(int color = 0; color<2 && it == cache.end(); color++) {
+		for(int bitmap = 0; bitmap<2 && it == cache.end(); bitmap++) {
+			int color_choice  = face == 0 ? (color  == 0 ? 0 : FT_LOAD_COLOR | FT_LOAD_TARGET_LCD)     : (color == 0  ? FT_LOAD_COLOR | FT_LOAD_TARGET_LCD    : 0);
+			int bitmap_choice = face == 0 ? (bitmap == 0 ? FT_LOAD_NO_BITMAP : 0) : (bitmap == 0 ? 0 : FT_LOAD_NO_BITMAP);
+			if (FT_Load_Glyph(faces.at(face), glyph_index, bitmap_choice | color_choice))
+				continue;
+
+			FT_GlyphSlot slot = faces.at(face)->glyph;
+			if (!slot)
+				continue;
+			FT_Glyph glyph { };
+			FT_Get_Glyph(slot, &glyph);
+
+			if (italic) {
+				FT_Matrix matrix { };
+				matrix.xx = 0x10000;
+				matrix.xy = 0x5000;
+				matrix.yx = 0;
+				matrix.yy = 0x10000;
+				if (FT_Glyph_Transform(glyph, &matrix, nullptr))
+					dolog(ll_info, "transform error");
+			}
+
+			if (glyph->format != FT_GLYPH_FORMAT_BITMAP) {
+				if (FT_Glyph_To_Bitmap(&glyph, color_choice ? FT_RENDER_MODE_LCD : FT_RENDER_MODE_NORMAL, nullptr, true)) {
+					FT_Done_Glyph(glyph);
+					continue;
+				}
+			}
+
+			glyph_cache_entry_t new_entry { };
+			FT_Bitmap_Init(&new_entry.bitmap);
+			FT_Bitmap_Copy(library, &reinterpret_cast<FT_BitmapGlyph>(glyph)->bitmap, &new_entry.bitmap);
+			new_entry.horiBearingX = slot->metrics.horiBearingX;
+			new_entry.bitmap_top   = slot->bitmap_top;
+
+			FT_Done_Glyph(glyph);
+
+			it = cache.insert({ glyph_index, new_entry }).first;
+		}
+	}
+
+	if (it == cache.end())
+		return nullptr;
+
+	*has_color = FT_HAS_COLOR(faces.at(face));
+
+	// map-nodes stay put, also when faces are added later on
+	return &it->second;
+}
+
+bool font_freetype::draw_glyph(const UChar32 utf_character, const intensity_t intensity, const bool invert, const bool underline, const bool strikethrough, const bool italic, const rgb_t & fg, const rgb_t & bg, const int x, const int y, uint8_t *const dest, const int dest_width, const int dest_height)
+{
+	const glyph_cache_entry_t *entry     = nullptr;
+	bool                       has_color = false;
+
+	{
+		// freetype2 is not thread safe
+		const std::lock_guard<std::mutex> lock(freetype2_lock);
+
+		if (is_box_drawing(utf_character))
+			entry = get_procedural_glyph(utf_character);
+
+		if (entry == nullptr)
+			entry = get_freetype_glyph(utf_character, italic, &has_color);
+	}
+
+	if (entry == nullptr)
+		return false;
+
+	// draw background
+	uint8_t max = get_intensity_multiplier(intensity);
+	uint8_t bg_r = invert ? (fg.r * max) >> 8 : (bg.r * max) >> 8;
+	uint8_t bg_g = invert ? (fg.g * max) >> 8 : (bg.g * max) >> 8;
+	uint8_t bg_b = invert ? (fg.b * max) >> 8 : (bg.b * max) >> 8;
+
+	for(int cy=0; cy<font_height; cy++) {
+		int offset_y = (y + cy) * dest_width * 3;
+
+		for(int cx=0; cx<font_width; cx++) {
+			int offset = offset_y + (x + cx) * 3;
+
+			dest[offset + 0] = bg_r;
+			dest[offset + 1] = bg_g;
+			dest[offset + 2] = bg_b;
+		}
+	}
+
+	draw_glyph_bitmap(entry, x, y, fg, bg, has_color, intensity, invert, underline, strikethrough, dest, dest_width, dest_height);
+
+	return true;
+}
@@ -0,0 +1,75 @@
+// (C) 2017-2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <freetype2/ft2build.h>
+#include FT_FREETYPE_H
+#include <freetype/ftglyph.h>
+
+#include <unicode/ustring.h>
+
+#include "common.h"
+#include "font.h"
+
+
+#define DEFAULT_FONT_FILE "/usr/share/fonts/truetype/unifont/unifont.ttf"
+
+extern std::mutex freetype2_lock;
+extern std::mutex fontconfig_lock;
+
+typedef struct {
+	FT_Bitmap bitmap;
+	int       horiBearingX;
+	int       bitmap_top;
+} glyph_cache_entry_t;
+
+typedef struct {
+	size_t    face;
+	FT_UInt   glyph_index;
+} glyph_resolution_t;
+
+class font_freetype : public font
+{
+private:
+	static FT_Library    library;
+
+	int                  max_ascender { 0 };
+	std::optional<int>   char_size_width;
+	int                  char_size_height { 0 };
+	std::vector<FT_Face> faces;
+	size_t               n_configured_faces { 0 };
+	std::vector<std::map<int, glyph_cache_entry_t> > glyph_cache;
+	std::vector<std::map<int, glyph_cache_entry_t> > glyph_cache_italic;
+	bool                 render_mode_error { false };
+
+	// code point -> face/glyph, includes faces found via fontconfig
+	std::map<UChar32, glyph_resolution_t> resolution_cache;
+	std::map<std::string, std::optional<size_t> > fallback_files;  // no value: could not be loaded
+	std::vector<std::pair<void *, size_t> > mapped_files;
+
+	// box drawing etc, rendered at exactly the cell size
+	std::map<UChar32, glyph_cache_entry_t> procedural_cache;
+
+	void setup_face(FT_Face face);
+	std::optional<size_t> load_fallback_face(const UChar32 c);
+	glyph_resolution_t    resolve_character(const UChar32 c);
+	const glyph_cache_entry_t * get_procedural_glyph(const UChar32 c);
+	const glyph_cache_entry_t * get_freetype_glyph(const UChar32 c, const bool italic, bool *const has_color);
+
+	std::optional<std::tuple<int, int, int, int> > find_text_dimensions(const UChar32 c);
+
+	void draw_glyph_bitmap_low(const FT_Bitmap *const bitmap, const rgb_t & fg, const rgb_t & bg, const bool has_color, const intensity_t intensity, const bool invert, const bool underline, const bool strikethrough, uint8_t **const result, int *const result_width, int *const result_height);
+	void draw_glyph_bitmap(const glyph_cache_entry_t *const glyph, const FT_Int x, const FT_Int y, const rgb_t & fg, const rgb_t & bg, const bool has_color, const intensity_t i, const bool invert, const bool underline, const bool strikethrough, uint8_t *const dest, const int dest_width, const int dest_height);
+
+public:
+	font_freetype(const std::vector<std::string> & font_files, std::optional<int> font_width, const int font_height_in);
+	virtual ~font_freetype();
+
+	bool draw_glyph(const UChar32 utf_character, const intensity_t i, const bool invert, const bool underline, const bool strikethrough, const bool italic, const rgb_t & fg, const rgb_t & bg, const int x, const int y, uint8_t *const dest, const int dest_width, const int dest_height) override;
+};
@@ -0,0 +1,93 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <chrono>
+#include <unistd.h>
+
+#include "frame-bus.h"
+#include "logging.h"
+#include "terminal.h"
+#include "time.h"
+#include "utils.h"
+
+
+frame_bus::frame_bus(terminal *const t, const int max_fps) :
+	t(t), max_fps(max_fps)
+{
+}
+
+frame_bus::~frame_bus()
+{
+	stop_flag = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+}
+
+void frame_bus::begin()
+{
+	th = new std::thread(std::ref(*this));
+}
+
+std::shared_ptr<frame> frame_bus::wait_for_frame(const uint64_t after_nr, const int max_wait)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto have_new = [this, after_nr] { return stop_flag || (latest != nullptr && latest->get_frame_nr() > after_nr); };
+
+	if (max_wait < 0)
+		cond.wait(lck, have_new);
+	else
+		cond.wait_for(lck, std::chrono::milliseconds(max_wait), have_new);
+
+	if (stop_flag)
+		return nullptr;
+
+	return latest;
+}
+
+std::shared_ptr<frame> frame_bus::get_latest()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	// only before the first frame was published
+	cond.wait(lck, [this] { return stop_flag || latest != nullptr; });
+
+	return latest;
+}
+
+void frame_bus::operator()()
+{
+	set_thread_name("frame-bus");
+
+	dolog(ll_info, "frame_bus: started with a maximum of %d frames per second", max_fps);
+
+	const uint64_t interval = max_fps > 0 ? 1000 / max_fps : 0;
+	uint64_t       ts_after = 0;
+
+	while(!stop_flag) {
+		uint64_t start = get_ms();
+
+		auto f = t->get_frame();
+
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			if (latest == nullptr || f->get_frame_nr() != latest->get_frame_nr()) {
+				latest = f;
+				cond.notify_all();
+			}
+		}
+
+		// wait for new output from the program; wake up regularly to let
+		// blinking progress
+		t->wait_for_frame(&ts_after, 100);
+
+		uint64_t took = get_ms() - start;
+		if (took < interval)
+			usleep((interval - took) * 1000);
+	}
+
+	std::unique_lock<std::mutex> lck(lock);
+	cond.notify_all();
+}
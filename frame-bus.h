@@ -0,0 +1,43 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "frame.h"
+
+
+class terminal;
+
+// one thread renders the terminal; HTTP/VNC clients subscribe to the result
+class frame_bus
+{
+private:
+	terminal        *const t       { nullptr };
+	const int        max_fps       { 25      };
+	std::atomic_bool stop_flag     { false   };
+	std::thread     *th            { nullptr };
+
+	std::mutex              lock;
+	std::condition_variable cond;
+	std::shared_ptr<frame>  latest;
+
+public:
+	frame_bus(terminal *const t, const int max_fps);
+	virtual ~frame_bus();
+
+	void begin();
+
+	// returns the most recent frame as soon as its number is higher than
+	// 'after_nr', or after 'max_wait' milliseconds (< 0: no timeout), in
+	// which case it can be the same frame again (or nullptr if none yet);
+	// nullptr when the bus is stopping
+	std::shared_ptr<frame> wait_for_frame(const uint64_t after_nr, const int max_wait);
+	std::shared_ptr<frame> get_latest();
+
+	void operator()();
+};
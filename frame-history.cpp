@@ -0,0 +1,91 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <unistd.h>
+
+#include "frame-bus.h"
+#include "frame-history.h"
+#include "logging.h"
+#include "picio.h"
+#include "stats.h"
+#include "time.h"
+#include "utils.h"
+
+
+frame_history::frame_history(frame_bus *const fb, const int max_seconds, const int max_fps, const size_t max_memory) :
+	fb(fb), max_seconds(max_seconds), max_fps(max_fps), max_memory(max_memory)
+{
+}
+
+frame_history::~frame_history()
+{
+	stop_flag = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+}
+
+void frame_history::begin()
+{
+	th = new std::thread(std::ref(*this));
+}
+
+std::vector<history_frame_t> frame_history::get(const int seconds)
+{
+	const uint64_t start = get_ms() - uint64_t(seconds) * 1000;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	size_t first = 0;
+	while(first + 1 < frames.size() && frames[first + 1].ts <= start)
+		first++;
+
+	return std::vector<history_frame_t>(frames.begin() + first, frames.end());
+}
+
+void frame_history::operator()()
+{
+	set_thread_name("frame-history");
+
+	dolog(ll_info, "frame_history: keeping %d seconds at %d frames per second", max_seconds, max_fps);
+
+	const uint64_t interval = max_fps > 0 ? 1000 / max_fps : 0;
+	uint64_t       frame_nr = 0;
+	uint64_t       added_ts = 0;
+
+	while(!stop_flag) {
+		uint64_t now = get_ms();
+		if (now - added_ts < interval)
+			usleep((interval - (now - added_ts)) * 1000);
+
+		auto f = fb->wait_for_frame(frame_nr, 500);
+		if (f == nullptr)  // shutting down
+			break;
+
+		if (f->get_frame_nr() == frame_nr)
+			continue;
+
+		uint8_t *out     = nullptr;
+		size_t   out_len = 0;
+		write_qoi(f->get_width(), f->get_height(), 0, f->get_pixels(PF_RGB), &out, &out_len);
+
+		frame_nr = f->get_frame_nr();
+		added_ts = get_ms();
+
+		std::unique_lock<std::mutex> lck(lock);
+
+		frames.push_back({ added_ts, make_encoded(out, out_len) });
+		memory += out_len;
+
+		// keep the frame that was visible at the start of the period
+		const uint64_t start = added_ts - uint64_t(max_seconds) * 1000;
+
+		while(frames.size() > 1 && (frames[1].ts <= start || memory > max_memory)) {
+			memory -= frames.front().qoi.len;
+			frames.pop_front();
+		}
+
+		stats.set("clip-history-frames", frames.size());
+		stats.set("clip-history-bytes",  memory);
+	}
+}
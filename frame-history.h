@@ -0,0 +1,50 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+
+class frame_bus;
+
+typedef struct {
+	uint64_t  ts;  // when it became visible, in ms
+	encoded_t qoi;
+} history_frame_t;
+
+// the frames of the last so many seconds, for clips; kept as QOI which is
+// cheap to encode and makes a terminal screen a fraction of its RGB size
+class frame_history
+{
+private:
+	frame_bus       *const fb          { nullptr };
+	const int        max_seconds       { 30 };
+	const int        max_fps           { 10 };
+	const size_t     max_memory        { 0 };
+	std::atomic_bool stop_flag         { false };
+	std::thread     *th                { nullptr };
+
+	std::mutex                  lock;
+	std::deque<history_frame_t> frames;
+	size_t                      memory { 0 };
+
+public:
+	frame_history(frame_bus *const fb, const int max_seconds, const int max_fps, const size_t max_memory);
+	virtual ~frame_history();
+
+	void begin();
+
+	int  get_max_seconds() const { return max_seconds; }
+
+	// oldest first; the first one is what was visible 'seconds' ago (or
+	// the oldest available)
+	std::vector<history_frame_t> get(const int seconds);
+
+	void operator()();
+};
@@ -0,0 +1,78 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <cstdlib>
+
+#include "frame.h"
+#include "stats.h"
+
+
+encoded_t make_encoded(uint8_t *const data, const size_t len)
+{
+	return { std::shared_ptr<const uint8_t>(data, [](const uint8_t *p) { free(const_cast<uint8_t *>(p)); }), len };
+}
+
+frame::frame(uint8_t *const rgb, const int w, const int h, const uint64_t nr, const uint64_t content_hash, const std::vector<rect_t> & damage) :
+	rgb(rgb), w(w), h(h), nr(nr), content_hash(content_hash), damage(damage)
+{
+}
+
+frame::~frame()
+{
+	for(auto & variant: variants)
+		free(variant.second);
+
+	free(rgb);
+}
+
+const uint8_t *frame::get_pixels(const pixel_format_t pf)
+{
+	if (pf == PF_RGB)
+		return rgb;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = variants.find(pf);
+	if (it != variants.end())
+		return it->second;
+
+	uint8_t *out = reinterpret_cast<uint8_t *>(malloc(get_pixel_format_size(pf, w, h)));
+	convert_rgb_pixels(rgb, w, h, pf, out);
+
+	variants.insert({ pf, out });
+
+	return out;
+}
+
+encoded_t frame::get_encoded(const std::string & name, const std::function<encoded_t(frame *const f)> & encode)
+{
+	std::promise<encoded_t> promise;
+
+	{
+		std::unique_lock<std::mutex> lck(encode_lock);
+
+		auto it = encoded.find(name);
+		if (it != encoded.end()) {
+			std::shared_future<encoded_t> result = it->second;
+
+			lck.unlock();
+
+			stats.add("duplicate-encodes-avoided");
+
+			return result.get();
+		}
+
+		encoded.insert({ name, promise.get_future().share() });
+	}
+
+	try {
+		encoded_t out = encode(this);
+
+		promise.set_value(out);
+
+		return out;
+	}
+	catch(...) {
+		promise.set_exception(std::current_exception());
+
+		throw;
+	}
+}
@@ -0,0 +1,67 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "pixfmt.h"
+
+
+// an encoded image (PNG, JPEG, ...); can be shared between frames, the
+// encoded-frame cache and clients
+typedef struct {
+	std::shared_ptr<const uint8_t> data;
+	size_t                         len;
+} encoded_t;
+
+// takes ownership of the malloc()ed buffer
+encoded_t make_encoded(uint8_t *const data, const size_t len);
+
+// one rendered terminal image; other pixel formats and encoded versions
+// (PNG, JPEG, ...) are produced on first use and then shared by all
+// consumers of this frame
+class frame
+{
+private:
+	uint8_t   *const rgb { nullptr };
+	const int        w   { 0 };
+	const int        h   { 0 };
+	const uint64_t   nr  { 0 };
+	const uint64_t   content_hash { 0 };
+	const std::vector<rect_t> damage;
+
+	std::mutex       lock;
+	std::map<pixel_format_t, uint8_t *> variants;
+
+	// an entry is added before encoding starts so that concurrent callers
+	// wait for that result instead of encoding the same image again
+	std::mutex       encode_lock;
+	std::map<std::string, std::shared_future<encoded_t> > encoded;
+
+public:
+	// takes ownership of 'rgb' (malloc()ed); 'content_hash' identifies what
+	// is visible, 'damage' lists the areas that differ from frame nr - 1
+	frame(uint8_t *const rgb, const int w, const int h, const uint64_t nr, const uint64_t content_hash, const std::vector<rect_t> & damage);
+	virtual ~frame();
+
+	int      get_width()     const { return w;  }
+	int      get_height()    const { return h;  }
+	uint64_t get_frame_nr()  const { return nr; }
+	uint64_t get_content_hash() const { return content_hash; }
+	const std::vector<rect_t> & get_damage() const { return damage; }
+
+	const uint8_t *get_pixels(const pixel_format_t pf);
+
+	// 'name' identifies the encoding (format and settings), 'encode' is
+	// invoked at most once per name; different names are encoded in
+	// parallel
+	encoded_t get_encoded(const std::string & name, const std::function<encoded_t(frame *const f)> & encode);
+};
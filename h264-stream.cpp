@@ -0,0 +1,154 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#if defined(HAVE_X264)
+#include <algorithm>
+#include <inttypes.h>
+
+#include "h264-stream.h"
+#include "logging.h"
+#include "pixfmt.h"
+#include "stats.h"
+
+
+h264_stream::h264_stream(const int w, const int h, const int crf) :
+	w(w & ~1), h(h & ~1), crf(crf),
+	muxer(w & ~1, h & ~1)
+{
+}
+
+h264_stream::~h264_stream()
+{
+	if (encoder)
+		x264_encoder_close(encoder);
+}
+
+bool h264_stream::begin()
+{
+	x264_param_t param;
+
+	if (x264_param_default_preset(&param, "veryfast", "zerolatency") < 0) {
+		dolog(ll_error, "h264_stream: x264 does not know the preset");
+		return false;
+	}
+
+	param.i_width          = w;
+	param.i_height         = h;
+	param.i_csp            = X264_CSP_I420;
+	param.i_log_level      = X264_LOG_WARNING;
+
+	// frames come when the screen changes: timestamps in ms
+	param.b_vfr_input      = 1;
+	param.i_timebase_num   = 1;
+	param.i_timebase_den   = 1000;
+	param.i_fps_num        = 25;
+	param.i_fps_den        = 1;
+
+	param.rc.i_rc_method   = X264_RC_CRF;
+	param.rc.f_rf_constant = crf;
+
+	// SPS and PPS go in the init segment, NAL units get a length prefix
+	param.b_repeat_headers = 0;
+	param.b_annexb         = 0;
+
+	// frame::get_pixels(PF_YUV420) is full range BT.601 (as JPEG)
+	param.vui.b_fullrange  = 1;
+	param.vui.i_colorprim  = 6;  // smpte170m
+	param.vui.i_transfer   = 6;
+	param.vui.i_colmatrix  = 6;
+
+	if (x264_param_apply_profile(&param, "high") < 0) {
+		dolog(ll_error, "h264_stream: x264 cannot apply the high profile");
+		return false;
+	}
+
+	encoder = x264_encoder_open(&param);
+	if (!encoder) {
+		dolog(ll_error, "h264_stream: cannot start x264 for %dx%d", w, h);
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<uint8_t> h264_stream::get_init_segment()
+{
+	x264_nal_t *nals   = nullptr;
+	int         n_nals = 0;
+
+	if (x264_encoder_headers(encoder, &nals, &n_nals) < 0)
+		return { };
+
+	std::vector<uint8_t> sps;
+	std::vector<uint8_t> pps;
+
+	for(int i=0; i<n_nals; i++) {
+		// without the 4 byte length
+		if (nals[i].i_type == NAL_SPS)
+			sps.assign(nals[i].p_payload + 4, nals[i].p_payload + nals[i].i_payload);
+		else if (nals[i].i_type == NAL_PPS)
+			pps.assign(nals[i].p_payload + 4, nals[i].p_payload + nals[i].i_payload);
+	}
+
+	if (sps.size() < 4 || pps.empty())
+		return { };
+
+	return muxer.get_init_segment(sps, pps);
+}
+
+std::vector<uint8_t> h264_stream::encode(frame *const f, const uint64_t ts)
+{
+	// the planes below must be at least as large as what x264 was set up for
+	if ((f->get_width() & ~1) != w || (f->get_height() & ~1) != h) {
+		dolog(ll_warning, "h264_stream: frame is %dx%d, the stream is %dx%d", f->get_width(), f->get_height(), w, h);
+		return { };
+	}
+
+	if (first_ts == 0) {
+		first_ts = ts;
+		prev_ts  = ts;
+	}
+
+	// the planes of the frame as they are; when the width or height is
+	// odd the last column or row is left out
+	const int      fw  = f->get_width();
+	const int      fh  = f->get_height();
+	const int      cw  = (fw + 1) / 2;
+	const int      ch  = (fh + 1) / 2;
+	const uint8_t *yuv = f->get_pixels(PF_YUV420);
+
+	x264_picture_t pic_in;
+	x264_picture_init(&pic_in);
+	pic_in.img.i_csp       = X264_CSP_I420;
+	pic_in.img.i_plane     = 3;
+	pic_in.img.plane[0]    = const_cast<uint8_t *>(yuv);
+	pic_in.img.plane[1]    = const_cast<uint8_t *>(yuv + fw * fh);
+	pic_in.img.plane[2]    = const_cast<uint8_t *>(yuv + fw * fh + cw * ch);
+	pic_in.img.i_stride[0] = fw;
+	pic_in.img.i_stride[1] = cw;
+	pic_in.img.i_stride[2] = cw;
+	pic_in.i_pts           = ts - first_ts;
+
+	x264_picture_t pic_out;
+	x264_nal_t    *nals   = nullptr;
+	int            n_nals = 0;
+
+	int size = x264_encoder_encode(encoder, &nals, &n_nals, &pic_in, &pic_out);
+	if (size < 0) {
+		dolog(ll_warning, "h264_stream: x264 failed encoding frame %" PRIu64, f->get_frame_nr());
+		return { };
+	}
+
+	if (size == 0)
+		return { };
+
+	// the duration of a frame is not known until the next one is there;
+	// the time since the previous frame is a guess that needs no waiting
+	// (the player goes by the decode time of each fragment)
+	const uint32_t duration = std::max(uint64_t(1), ts - prev_ts);
+	prev_ts = ts;
+
+	stats.add(pic_out.b_keyframe ? "h264-keyframes" : "h264-frames");
+
+	// the NAL units (with length prefix) are contiguous
+	return muxer.get_fragment(nals[0].p_payload, size, pic_out.b_keyframe, std::max(int64_t(0), pic_out.i_dts), duration);
+}
+#endif
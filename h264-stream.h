@@ -0,0 +1,44 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#if defined(HAVE_X264)
+#include <stdint.h>
+#include <vector>
+extern "C" {
+#include <x264.h>
+}
+
+#include "fmp4.h"
+#include "frame.h"
+
+
+// H.264 of the frames for one client, as fragmented MP4; tuned for
+// latency (no B-frames, no lookahead: a frame is out as soon as it is
+// in) and a screen that is mostly static (an unchanged frame costs a few
+// bytes)
+class h264_stream
+{
+private:
+	const int   w   { 0 };  // even, as 4:2:0 wants
+	const int   h   { 0 };
+	const int   crf { 28 };
+	x264_t     *encoder { nullptr };
+	fmp4_muxer  muxer;
+	uint64_t    first_ts { 0 };
+	uint64_t    prev_ts  { 0 };
+
+public:
+	h264_stream(const int w, const int h, const int crf);
+	virtual ~h264_stream();
+
+	// false when x264 refuses the settings
+	bool begin();
+
+	std::vector<uint8_t> get_init_segment();
+
+	// 'ts' (ms) is when it became visible; returns the fragment for the
+	// frame, nothing when x264 did not produce one or when the frame does
+	// not have the size of the stream
+	std::vector<uint8_t> encode(frame *const f, const uint64_t ts);
+};
+#endif
@@ -1,97 +1,128 @@
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
+#include <unistd.h>
+#include <vector>
+
+#include "animation.h"
+#include "content-encoding.h"
+#include "delta.h"
+#include "encoders.h"
+#include "h264-stream.h"
 #include "http.h"
+#include "jpeg-cells.h"
 #include "logging.h"
 #include "net-io.h"
 #include "picio.h"
+#include "pixfmt.h"
+#include "stats.h"
 #include "str.h"
 #include "terminal.h"
+#include "time.h"
 
 
-typedef enum { sct_none, sct_mjpeg, sct_mpng, sct_mbmp, sct_mtga } stream_content_type_t;
-
-typedef void (*writer)(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
+encoder_registry encoders;
 
-class cached_renderer
+// returns the value of 'key' in the query string of 'url' (if any)
+std::optional<std::string> get_url_parameter(const std::string & url, const std::string & key)
 {
-private:
-	writer      pw       { nullptr };
-	http_server_parameters_t *hsp { nullptr };
-	uint64_t    ts_after { 0       };
-	std::mutex  lock;
-	uint8_t    *prev     { nullptr };
-	size_t      prev_size{ 0       };
-
-public:
-	cached_renderer(writer pw, http_server_parameters_t *const hsp): pw(pw), hsp(hsp) {
-	}
+	std::size_t question = url.find('?');
 
-	virtual ~cached_renderer() {
-		free(prev);
+	if (question == std::string::npos)
+		return { };
+
+	for(auto & pair: split(url.substr(question + 1), "&")) {
+		std::size_t is = pair.find('=');
+
+		if (is != std::string::npos && pair.substr(0, is) == key)
+			return pair.substr(is + 1);
 	}
 
-	std::optional<std::tuple<uint8_t *, size_t, bool> > get_frame(const bool peek) {
-		if (peek && hsp->t->has_new_frame() == false)
-			return { };
-
-		bool     changed = true;
-		uint8_t *temp    = nullptr;
-		int      temp_w  = 0;
-		int      temp_h  = 0;
-		if (hsp->t->has_new_frame() || prev == nullptr) {
-			hsp->t->wait_for_frame(&ts_after, hsp->max_wait);
-			hsp->t->render(&temp, &temp_w, &temp_h);
-
-			uint8_t *compressed      = nullptr;
-			size_t   compressed_size = 0;
-			pw(temp_w, temp_h, hsp->compression_level, temp, &compressed, &compressed_size);
-			free(temp);
-
-			std::unique_lock<std::mutex> lck(lock);
-			free(prev);
-			prev      = compressed;
-			prev_size = compressed_size;
+	return { };
+}
+
+std::optional<int> get_url_parameter_int(const std::string & url, const std::string & key)
+{
+	auto value = get_url_parameter(url, key);
+
+	if (value.has_value()) {
+		try {
+			return std::stoi(value.value());
 		}
-		else if (peek)
-			return { };
-		else {
-			changed = false;
+		catch(...) {
+			dolog(ll_debug, "get_url_parameter_int: invalid %s \"%s\"", key.c_str(), value.value().c_str());
 		}
+	}
 
-		uint8_t *out = reinterpret_cast<uint8_t *>(malloc(prev_size));
-		memcpy(out, prev, prev_size);
+	return { };
+}
 
-		return { { out, prev_size, changed } };
+// the format is selected by the extension of the url (/frame.png,
+// /stream.mpng) or, without one (/frame, /stream), by the Accept header
+std::shared_ptr<cached_renderer> select_renderer(const std::string & url, const std::map<std::string, std::string> & headers, const bool stream, const http_server_parameters_t *const hsp)
+{
+	const std::string path = url.substr(0, url.find('?'));
+
+	std::optional<std::string> extension;
+
+	std::size_t dot = path.rfind('.');
+	if (dot != std::string::npos)
+		extension = path.substr(dot + 1 + stream);  // skip the 'm' of "mjpeg"
+	else {
+		auto accept = headers.find("accept");
+
+		extension = encoders.select(accept == headers.end() ? "*/*" : accept->second);
 	}
-};
 
-std::map<std::string, cached_renderer *> cr;
+	if (extension.has_value() == false)
+		return nullptr;
 
-std::optional<std::tuple<uint8_t *, size_t, bool> > get_jpeg_frame(const bool peek)
-{
-	return cr.find("jpg")->second->get_frame(peek);
+	return encoders.subscribe(extension.value(), hsp->ec);
 }
 
-std::optional<std::tuple<uint8_t *, size_t, bool> > get_png_frame(const bool peek)
+// transport compression for formats that are not compressed themselves,
+// when the client asks for it
+std::string pick_content_encoding(const std::map<std::string, std::string> & headers, const cached_renderer *const renderer)
 {
-	return cr.find("png")->second->get_frame(peek);
-}
+	if (renderer->get_encoder().compressible == false)
+		return "";
 
-std::optional<std::tuple<uint8_t *, size_t, bool> > get_bmp_frame(const bool peek)
-{
-	return cr.find("bmp")->second->get_frame(peek);
+	auto accept_encoding = headers.find("accept-encoding");
+	if (accept_encoding == headers.end())
+		return "";
+
+	return select_content_encoding(accept_encoding->second).value_or("");
 }
 
-std::optional<std::tuple<uint8_t *, size_t, bool> > get_tga_frame(const bool peek)
+// tells caches which request headers selected the format and encoding
+std::string get_vary_header(const std::string & url, const cached_renderer *const renderer)
 {
-	return cr.find("tga")->second->get_frame(peek);
+	std::vector<std::string> vary;
+
+	const std::string path = url.substr(0, url.find('?'));
+	if (path.find('.') == std::string::npos)
+		vary.push_back("Accept");
+
+	if (renderer->get_encoder().compressible)
+		vary.push_back("Accept-Encoding");
+
+	if (vary.empty())
+		return "";
+
+	std::string out = "Vary: ";
+	for(size_t i=0; i<vary.size(); i++)
+		out += (i ? ", " : "") + vary[i];
+
+	return out + "\r\n";
 }
 
-void get_html_root(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+void get_html_root(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
 	std::string reply = 
 			"HTTP/1.0 " + std::string(peek ? "304" : "200") + " OK\r\n"
@@ -107,152 +138,626 @@ void get_html_root(const std::string url, net_io *const io, const void *const pa
 	io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
 }
 
-void send_frame(net_io *const io, const std::string & mime_type, const std::optional<std::tuple<uint8_t *, size_t, bool> > & image)
+void get_stats(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
-	if (image.has_value() == false) {
-		std::string reply =
-			"HTTP/1.0 304 OK\r\n"
-			"Content-Type: image/" + mime_type + "\r\n"
+	std::string json  = stats.get_json();
+	std::string reply =
+			"HTTP/1.0 200 OK\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Content-Type: application/json\r\n"
 			"\r\n";
 
+	if (!peek)
+		reply += json;
+
+	io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+}
+
+void get_frame(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+{
+	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
+
+	auto renderer = select_renderer(url, headers, false, hsp);
+	if (renderer == nullptr) {
+		std::string reply = "HTTP/1.0 406 Not Acceptable\r\n\r\n";
 		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
 	}
-	else {
-		std::string reply;
 
-		if (std::get<2>(image.value())) {
-			reply =
-				"HTTP/1.0 200 OK\r\n"
-				"Content-Type: image/" + mime_type + "\r\n"
-				"\r\n";
+	auto f = hsp->fb->get_latest();
+	if (f == nullptr)  // shutting down
+		return;
+
+	const std::string & mime_type        = renderer->get_encoder().mime_type;
+	const std::string   content_encoding = pick_content_encoding(headers, renderer.get());
+	const bool          changed          = renderer->is_new(f.get());
+
+	std::string reply =
+		"HTTP/1.0 " + std::string(changed ? "200" : "304") + " OK\r\n"
+		"Content-Type: " + mime_type + "\r\n";
+	if (content_encoding.empty() == false)
+		reply += "Content-Encoding: " + content_encoding + "\r\n";
+	reply += get_vary_header(url, renderer.get());
+	reply += "\r\n";
+
+	if (peek) {
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
+	}
+
+	// the encoded bytes are shared with the frame and the other clients
+	encoded_t data = renderer->encode(f.get(), get_url_parameter_int(url, "level").value_or(hsp->compression_level), content_encoding);
+
+	if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()))
+		io->send(data.data.get(), data.len);
+}
+
+// sends a part whenever there is a new frame (at most 'max_fps' per second)
+// and repeats at the keepalive interval; 'get_part' returns the headers
+// and the data of the part for a frame, or nothing to end the stream.
+// the parts are multipart/x-mixed-
+// replace or, with a 'content_type', one file sent as it grows (the part
+// headers are then not used); 'extra_headers' go in the http response
+void stream_parts(net_io *const io, const http_server_parameters_t *const parameters, const std::string & content_type, const std::string & extra_headers, const std::function<std::optional<std::pair<std::string, encoded_t> >(const std::shared_ptr<frame> & f)> & get_part, const int max_fps, std::atomic_bool & stop_flag)
+{
+	const bool multipart = content_type.empty();
+
+	std::string reply =
+		"HTTP/1.0 200 OK\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Pragma: no-cache\r\n"
+		"Server: TermCamNG\r\n"
+		"Expires: Thu, 01 Dec 1994 16:00:00 GMT\r\n"
+		"Connection: close\r\n"
+		"Content-Type: " + (multipart ? "multipart/x-mixed-replace; boundary=myboundary" : content_type) + "\r\n" +
+		extra_headers +
+		"\r\n";
+
+	if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) == false) {
+		dolog(ll_debug, "stream_parts: failed sending http headers");
+		return;
+	}
+
+	// 'max_wait' is the keepalive interval (minimum-fps), 0 for none
+	const uint64_t keepalive_interval = parameters->max_wait;
+	const uint64_t frame_interval     = max_fps > 0 ? 1000 / max_fps : 0;
+
+	uint64_t frame_nr = 0;
+	uint64_t sent_ts  = 0;
+
+	while(!stop_flag) {
+		// do not send more frames than the client asked for
+		uint64_t now = get_ms();
+		if (now - sent_ts < frame_interval)
+			usleep((frame_interval - (now - sent_ts)) * 1000);
+
+		// wait for the next frame, at most until a keepalive is due; wake
+		// up regularly to see if the server is stopping
+		int max_wait = 500;
+		if (keepalive_interval && sent_ts)
+			max_wait = std::max(int64_t(0), std::min(int64_t(max_wait), int64_t(sent_ts + keepalive_interval) - int64_t(get_ms())));
+
+		auto f = parameters->fb->wait_for_frame(frame_nr, max_wait);
+		if (f == nullptr)  // shutting down
+			break;
+
+		bool is_new = f->get_frame_nr() != frame_nr;
+
+		if (is_new == false && (keepalive_interval == 0 || get_ms() - sent_ts < keepalive_interval))
+			continue;
+
+		auto part = get_part(f);
+		if (part.has_value() == false)
+			break;
+
+		const encoded_t & data = part.value().second;
+
+		if (multipart) {
+			std::string reply = myformat("\r\n--myboundary\r\n%sContent-Length: %zu\r\n\r\n", part.value().first.c_str(), data.len);
+
+			if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) == false) {
+				dolog(ll_debug, "stream_parts: failed sending multipart http headers");
+				break;
+			}
 		}
-		else {
-			reply =
-				"HTTP/1.0 304 OK\r\n"
-				"Content-Type: image/" + mime_type + "\r\n"
-				"\r\n";
+
+		if (data.len && io->send(data.data.get(), data.len) == false) {
+			dolog(ll_debug, "stream_parts: failed sending frame data");
+			break;
 		}
 
-		if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()))
-			io->send(std::get<0>(image.value()), std::get<1>(image.value()));
+		frame_nr = f->get_frame_nr();
+		sent_ts  = get_ms();
+
+		stats.add(is_new ? "stream-frames-sent" : "stream-keepalives-sent");
+	}
+}
+
+void get_stream(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+{
+	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
 
-		free(std::get<0>(image.value()));
+	// the encoder stays instantiated as long as this stream runs
+	auto renderer = select_renderer(url, headers, true, hsp);
+	if (renderer == nullptr) {
+		std::string reply = "HTTP/1.0 406 Not Acceptable\r\n\r\n";
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
 	}
+
+	// per client limits, e.g. /stream.mjpeg?fps=5&level=50
+	int max_fps = std::max(0, get_url_parameter_int(url, "fps").value_or(0));
+	int level   = get_url_parameter_int(url, "level").value_or(hsp->compression_level);
+
+	const std::string content_encoding = pick_content_encoding(headers, renderer.get());
+
+	std::string part_headers = "Content-Type: " + renderer->get_encoder().mime_type + "\r\n";
+	if (content_encoding.empty() == false)  // per part: the stream itself is not compressed
+		part_headers += "Content-Encoding: " + content_encoding + "\r\n";
+
+	stream_parts(io, hsp, "", get_vary_header(url, renderer.get()), [&](const std::shared_ptr<frame> & f) {
+			return std::make_pair(part_headers, renderer->encode(f.get(), level, content_encoding));
+		}, max_fps, stop_flag);
 }
 
-void get_frame_jpeg(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+// /delta.mpng, /delta.mqoi: keyframes and parts with only what changed,
+// see delta.h
+void get_delta_stream(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
-	send_frame(io, "jpeg", get_jpeg_frame(peek));
+	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
+
+	auto renderer = select_renderer(url, headers, true, hsp);
+	if (renderer == nullptr) {
+		std::string reply = "HTTP/1.0 406 Not Acceptable\r\n\r\n";
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
+	}
+
+	// e.g. /delta.mpng?fps=5&keyframe=30 (seconds, 0 for only the first)
+	int      max_fps           = std::max(0, get_url_parameter_int(url, "fps").value_or(0));
+	int      level             = get_url_parameter_int(url, "level").value_or(hsp->compression_level);
+	uint64_t keyframe_interval = uint64_t(std::max(0, get_url_parameter_int(url, "keyframe").value_or(hsp->keyframe_interval))) * 1000;
+
+	int cell_w = 0;
+	int cell_h = 0;
+	hsp->t->get_cell_dimensions(&cell_w, &cell_h);
+
+	std::shared_ptr<frame> prev;  // what the client has on its canvas
+	uint64_t               keyframe_ts = 0;
+
+	stream_parts(io, hsp, "", "", [&](const std::shared_ptr<frame> & f) {
+			uint64_t now = get_ms();
+
+			encoded_t data;
+			if (prev == nullptr || (keyframe_interval && now - keyframe_ts >= keyframe_interval))
+				data = make_keyframe(f.get(), renderer.get(), level);
+			else
+				data = make_delta(prev.get(), f.get(), renderer.get(), level, cell_w, cell_h);
+
+			if (data.data.get()[0] == DELTA_KEYFRAME)
+				keyframe_ts = now;
+
+			prev = f;
+
+			return std::make_pair(std::string("Content-Type: application/x-termcamng-delta\r\n"), data);
+		}, max_fps, stop_flag);
 }
 
-void get_frame_png(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+// draws the parts of a delta stream on a canvas; /delta.html?format=qoi
+// selects QOI instead of PNG, other parameters are passed on
+void get_delta_html(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
-	send_frame(io, "png", get_png_frame(peek));
+	std::string reply =
+			"HTTP/1.0 " + std::string(peek ? "304" : "200") + " OK\r\n"
+			"Content-Type: text/html\r\n"
+			"\r\n";
+
+	if (!peek)
+		reply += R"EOF(<!DOCTYPE html>
+<html lang="en">
+<body>
+<canvas id="screen"></canvas>
+<script>
+const parameters = new URLSearchParams(location.search);
+const format     = parameters.get('format') === 'qoi' ? 'qoi' : 'png';
+const canvas     = document.getElementById('screen');
+const ctx        = canvas.getContext('2d');
+
+function decode_qoi(d, w, h) {
+	const img   = ctx.createImageData(w, h);
+	const out   = img.data;
+	const index = new Uint8Array(64 * 4);
+	let r = 0, g = 0, b = 0, a = 255, p = 14, run = 0;
+	for(let o=0; o<out.length; o+=4) {
+		if (run > 0)
+			run--;
+		else {
+			const b1 = d[p++];
+			if (b1 === 0xfe) { r = d[p++]; g = d[p++]; b = d[p++]; }
+			else if (b1 === 0xff) { r = d[p++]; g = d[p++]; b = d[p++]; a = d[p++]; }
+			else if ((b1 & 0xc0) === 0x00) { r = index[b1 * 4]; g = index[b1 * 4 + 1]; b = index[b1 * 4 + 2]; a = index[b1 * 4 + 3]; }
+			else if ((b1 & 0xc0) === 0x40) { r = (r + ((b1 >> 4) & 3) - 2) & 255; g = (g + ((b1 >> 2) & 3) - 2) & 255; b = (b + (b1 & 3) - 2) & 255; }
+			else if ((b1 & 0xc0) === 0x80) {
+				const b2 = d[p++], vg = (b1 & 0x3f) - 32;
+				r = (r + vg - 8 + ((b2 >> 4) & 15)) & 255; g = (g + vg) & 255; b = (b + vg - 8 + (b2 & 15)) & 255;
+			}
+			else run = b1 & 0x3f;
+			const i = ((r * 3 + g * 5 + b * 7 + a * 11) % 64) * 4;
+			index[i] = r; index[i + 1] = g; index[i + 2] = b; index[i + 3] = a;
+		}
+		out[o] = r; out[o + 1] = g; out[o + 2] = b; out[o + 3] = a;
+	}
+	return img;
+}
+
+async function draw_part(part) {
+	const v = new DataView(part.buffer, part.byteOffset, part.byteLength);
+	const w = v.getUint16(1), h = v.getUint16(3), n = v.getUint16(5);
+	if (canvas.width !== w || canvas.height !== h) {
+		canvas.width  = w;
+		canvas.height = h;
+	}
+	for(let i=0, o=7; i<n; i++) {
+		const x = v.getUint16(o), y = v.getUint16(o + 2), rw = v.getUint16(o + 4), rh = v.getUint16(o + 6), len = v.getUint32(o + 8);
+		const image = part.subarray(o + 12, o + 12 + len);
+		if (format === 'qoi')
+			ctx.putImageData(decode_qoi(image, rw, rh), x, y);
+		else
+			ctx.drawImage(await createImageBitmap(new Blob([image], { type: 'image/png' })), x, y);
+		o += 12 + len;
+	}
+}
+
+function find_header_end(buffer) {
+	for(let i=0; i+3<buffer.length; i++) {
+		if (buffer[i] === 13 && buffer[i + 1] === 10 && buffer[i + 2] === 13 && buffer[i + 3] === 10)
+			return i;
+	}
+	return -1;
+}
+
+async function run() {
+	try {
+		const response = await fetch('/delta.m' + format + location.search);
+		const reader   = response.body.getReader();
+		let   buffer   = new Uint8Array(0);
+		for(;;) {
+			const { value, done } = await reader.read();
+			if (done)
+				break;
+			const joined = new Uint8Array(buffer.length + value.length);
+			joined.set(buffer);
+			joined.set(value, buffer.length);
+			buffer = joined;
+			for(;;) {
+				const end = find_header_end(buffer);
+				if (end < 0)
+					break;
+				const length = /content-length: *(\d+)/i.exec(new TextDecoder().decode(buffer.subarray(0, end)));
+				const start  = end + 4;
+				if (length === null) {
+					buffer = buffer.subarray(start);
+					continue;
+				}
+				if (buffer.length < start + Number(length[1]))
+					break;
+				await draw_part(buffer.subarray(start, start + Number(length[1])));
+				buffer = buffer.subarray(start + Number(length[1]));
+			}
+		}
+	}
+	catch(e) {
+		console.log(e);
+	}
+	// reconnect; the first part is a keyframe
+	setTimeout(run, 1000);
+}
+
+run();
+</script>
+</body>
+</html>
+)EOF";
+
+	io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
 }
 
-void get_frame_bmp(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+#if defined(HAVE_X264)
+// /stream.mp4: H.264 in fragmented MP4 for a <video> tag, one encoder per
+// client; when nothing changes, the keepalives (minimum-fps) are frames of
+// a few bytes that keep the video going
+void get_h264_stream(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
-	send_frame(io, "bmp", get_bmp_frame(peek));
+	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
+
+	auto f = hsp->fb->get_latest();
+	if (f == nullptr)  // shutting down
+		return;
+
+	// e.g. /stream.mp4?crf=23&fps=10
+	int max_fps = std::max(0, get_url_parameter_int(url, "fps").value_or(0));
+	int crf     = std::max(0, std::min(51, get_url_parameter_int(url, "crf").value_or(hsp->h264_crf)));
+
+	h264_stream encoder(f->get_width(), f->get_height(), crf);
+
+	std::vector<uint8_t> init_segment;
+	if (encoder.begin())
+		init_segment = encoder.get_init_segment();
+
+	if (init_segment.empty()) {
+		std::string reply = "HTTP/1.0 500 Internal Server Error\r\n\r\n";
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
+	}
+
+	const int w = f->get_width();
+	const int h = f->get_height();
+
+	stream_parts(io, hsp, "video/mp4", "", [&](const std::shared_ptr<frame> & f) -> std::optional<std::pair<std::string, encoded_t> > {
+			// the size of a video cannot change (DECCOLM); the player can reconnect
+			if (f->get_width() != w || f->get_height() != h) {
+				dolog(ll_debug, "get_h264_stream: terminal resized, ending stream");
+				return { };
+			}
+
+			auto data = std::make_shared<std::vector<uint8_t> >(encoder.encode(f.get(), get_ms()));
+
+			// the init segment goes with the first fragment
+			if (init_segment.empty() == false) {
+				data->insert(data->begin(), init_segment.begin(), init_segment.end());
+				init_segment.clear();
+			}
+
+			// shares the vector instead of copying it
+			return std::make_pair(std::string(), encoded_t { std::shared_ptr<const uint8_t>(data, data->data()), data->size() });
+		}, max_fps, stop_flag);
 }
+#endif
+
+// a new frame is shown as soon as it has arrived
+#define ANIMATION_STREAM_DELAY 20
 
-void get_frame_tga(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+static std::unique_ptr<animation_writer> create_animation_writer(const std::string & url, const http_server_parameters_t *const hsp, const int w, const int h, std::string *const mime_type)
 {
-	send_frame(io, "tga", get_tga_frame(peek));
+	const std::string path  = url.substr(0, url.find('?'));
+	const int         level = get_url_parameter_int(url, "level").value_or(hsp->compression_level);
+
+	if (path.substr(path.rfind('.') + 1) == "gif") {
+		*mime_type = "image/gif";
+		return std::make_unique<gif_writer>(w, h, hsp->t->get_256c_palette());
+	}
+
+	*mime_type = "image/apng";
+	return std::make_unique<apng_writer>(w, h, std::max(0, std::min(100, level)));
 }
 
-void stream_frames(net_io *const io, const http_server_parameters_t *const parameters, const stream_content_type_t type, std::atomic_bool & stop_flag)
+// /stream.gif, /stream.apng: one animated image that does not end, for
+// viewers that do not do multipart; a frame only contains the area that
+// changed
+void get_animation_stream(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
+	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
+
+	auto f = hsp->fb->get_latest();
+	if (f == nullptr)  // shutting down
+		return;
+
+	const int w = f->get_width();
+	const int h = f->get_height();
+
+	std::string mime_type;
+	auto        writer = create_animation_writer(url, hsp, w, h, &mime_type);
+
 	std::string reply =
 		"HTTP/1.0 200 OK\r\n"
 		"Cache-Control: no-cache\r\n"
 		"Pragma: no-cache\r\n"
 		"Server: TermCamNG\r\n"
-		"Expires: Thu, 01 Dec 1994 16:00:00 GMT\r\n"
 		"Connection: close\r\n"
-		"Content-Type: multipart/x-mixed-replace; boundary=myboundary\r\n"
+		"Content-Type: " + mime_type + "\r\n"
 		"\r\n";
 
-	if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) == false) {
-		dolog(ll_debug, "stream_frames: failed sending http headers");
+	if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) == false || peek)
 		return;
-	}
 
-	for(;!stop_flag;) {
-		std::optional<std::tuple<uint8_t *, size_t, bool> > image;
-		std::string format = "";
+	auto header = writer->get_header(0);
+	if (io->send(header.data(), header.size()) == false)
+		return;
 
-		if (type == sct_mpng)
-			image = get_png_frame (false), format = "png";
-		else if (type == sct_mjpeg)
-			image = get_jpeg_frame(false), format = "jpeg";
-		else if (type == sct_mbmp)
-			image = get_bmp_frame (false), format = "bmp";
-		else if (type == sct_mtga)
-			image = get_tga_frame (false), format = "tga";
+	const int      max_fps        = std::max(0, get_url_parameter_int(url, "fps").value_or(0));
+	const uint64_t frame_interval = max_fps > 0 ? 1000 / max_fps : 0;
 
-		std::string reply = myformat("\r\n--myboundary\r\nContent-Type: image/%s\r\nContent-Length: %zu\r\n\r\n", format.c_str(), std::get<1>(image.value()));
+	std::shared_ptr<frame> prev;
+	uint64_t               sent_ts = 0;
 
-		if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) == false) {
-			dolog(ll_debug, "stream_frames: failed sending multipart http headers");
-			free(std::get<0>(image.value()));
+	while(!stop_flag) {
+		uint64_t now = get_ms();
+		if (now - sent_ts < frame_interval)
+			usleep((frame_interval - (now - sent_ts)) * 1000);
+
+		f = hsp->fb->wait_for_frame(prev ? prev->get_frame_nr() : 0, 500);
+		if (f == nullptr)  // shutting down
+			break;
+
+		if (prev && f->get_frame_nr() == prev->get_frame_nr())
+			continue;
+
+		// an animation cannot change size (DECCOLM)
+		if (f->get_width() != w || f->get_height() != h) {
+			dolog(ll_debug, "get_animation_stream: terminal resized, ending stream");
 			break;
 		}
 
-		if (io->send(std::get<0>(image.value()), std::get<1>(image.value())) == false) {
-			dolog(ll_debug, "stream_frames: failed sending frame data");
-			free(std::get<0>(image.value()));
+		const uint8_t *rgb = f->get_pixels(PF_RGB);
+		rect_t         r   = prev ? find_changed_area(prev->get_pixels(PF_RGB), rgb, w, h) : rect_t { 0, 0, w, h };
+
+		prev = f;
+
+		if (r.w == 0)
+			continue;
+
+		auto data = writer->add_frame(rgb, r, ANIMATION_STREAM_DELAY);
+		if (io->send(data.data(), data.size()) == false) {
+			dolog(ll_debug, "get_animation_stream: failed sending frame data");
 			break;
 		}
 
-		free(std::get<0>(image.value()));
+		sent_ts = get_ms();
+
+		stats.add("animation-frames-sent");
 	}
+
+	auto trailer = writer->get_trailer();
+	io->send(trailer.data(), trailer.size());
 }
 
-void get_stream(const std::string url, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
+// /clip.gif, /clip.apng: the last '?seconds=..' seconds (at most what is
+// configured with clip-seconds) as an animation
+void get_clip(const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *const parameters, std::atomic_bool & stop_flag, const bool peek)
 {
 	const http_server_parameters_t *const hsp = reinterpret_cast<const http_server_parameters_t *>(parameters);
 
-	std::size_t dot = url.rfind('.');
+	std::vector<history_frame_t> frames;
+	int seconds = 0;
 
-	if (dot == std::string::npos)
+	if (hsp->fh) {
+		seconds = std::max(1, std::min(hsp->fh->get_max_seconds(), get_url_parameter_int(url, "seconds").value_or(hsp->fh->get_max_seconds())));
+		frames  = hsp->fh->get(seconds);
+	}
+
+	if (frames.empty()) {
+		std::string reply = "HTTP/1.0 404 Not Found\r\n\r\n";
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
 		return;
+	}
+
+	const uint64_t now   = get_ms();
+	const uint64_t start = now - uint64_t(seconds) * 1000;
 
-	const std::string extension = url.substr(dot + 1);
+	std::string                       mime_type;
+	std::unique_ptr<animation_writer> writer;
+	std::vector<uint8_t>              body;
+	int                               n_frames = 0;
 
-	stream_content_type_t sct = sct_none;
+	uint8_t *prev   = nullptr;
+	int      prev_w = 0;
+	int      prev_h = 0;
 
-	if (extension == "mjpeg")
-		sct = sct_mjpeg;
-	else if (extension == "mpng")
-		sct = sct_mpng;
-	else if (extension == "mbmp")
-		sct = sct_mbmp;
-	else if (extension == "mtga")
-		sct = sct_mtga;
+	for(size_t i=0; i<frames.size(); i++) {
+		int      w   = 0;
+		int      h   = 0;
+		uint8_t *rgb = nullptr;
+		if (read_qoi(frames[i].qoi.data.get(), frames[i].qoi.len, &w, &h, &rgb) == false) {
+			dolog(ll_warning, "get_clip: frame %zu of history is corrupt", i);
+			break;
+		}
 
-	if (sct != sct_none)
-		stream_frames(io, hsp, sct, stop_flag);
+		if (writer == nullptr)
+			writer = create_animation_writer(url, hsp, w, h, &mime_type);
+		else if (w != prev_w || h != prev_h) {  // resized: the clip ends here
+			free(rgb);
+			break;
+		}
+
+		// shown until the next one became visible; the last until now
+		const uint64_t shown_ts = std::max(frames[i].ts, start);
+		const uint64_t next_ts  = i + 1 < frames.size() ? frames[i + 1].ts : std::max(now, shown_ts + 100);
+
+		// frames in the history always differ, yet a clip needs one per entry
+		rect_t r = prev ? find_changed_area(prev, rgb, w, h) : rect_t { 0, 0, w, h };
+		if (r.w == 0)
+			r = { 0, 0, 1, 1 };
+
+		auto data = writer->add_frame(rgb, r, next_ts - shown_ts);
+		body.insert(body.end(), data.begin(), data.end());
+		n_frames++;
+
+		free(prev);
+		prev   = rgb;
+		prev_w = w;
+		prev_h = h;
+	}
+
+	free(prev);
+
+	if (writer == nullptr) {
+		std::string reply = "HTTP/1.0 500 Internal Server Error\r\n\r\n";
+		io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size());
+		return;
+	}
+
+	// the header does not depend on the frames; made afterwards because
+	// the clip can end early and APNG needs the exact number of frames
+	auto header = writer->get_header(n_frames);
+	body.insert(body.begin(), header.begin(), header.end());
+
+	auto trailer = writer->get_trailer();
+	body.insert(body.end(), trailer.begin(), trailer.end());
+
+	stats.add("clips-exported");
+
+	std::string extension = mime_type == "image/gif" ? "gif" : "png";
+	std::string reply     = myformat(
+		"HTTP/1.0 200 OK\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Disposition: inline; filename=\"termcamng-clip.%s\"\r\n"
+		"Content-Length: %zu\r\n"
+		"\r\n", mime_type.c_str(), extension.c_str(), body.size());
+
+	if (io->send(reinterpret_cast<const uint8_t *>(reply.c_str()), reply.size()) && !peek)
+		io->send(body.data(), body.size());
+}
+
+static void register_encoders(const http_server_parameters_t *const hsp)
+{
+	// the first one is used when a client accepts any image type
+	encoders.add({ "jpeg", "image/jpeg", PF_YUV420, 0, 100, write_jpg,    false });
+	encoders.add({ "png",  "image/png",  PF_RGB,    0, 100, write_png,    false });
+	encoders.add({ "bmp",  "image/bmp",  PF_BGR,    0, 0,   write_bmp,    true  });
+	encoders.add({ "tga",  "image/x-tga", PF_BGR,   0, 0,   write_tga,    true  });
+	encoders.add({ "qoi",  "image/qoi",  PF_RGB,    0, 0,   write_qoi,    false });
+	// width and height (16 bit, big endian) followed by the RGB pixels
+	encoders.add({ "raw",  "application/octet-stream", PF_RGB, 0, 0, write_simple, true });
+
+	// experimental: only pays off when JPEG blocks do not cross cells
+	int cell_w = 0;
+	int cell_h = 0;
+	hsp->t->get_cell_dimensions(&cell_w, &cell_h);
+
+	if (cell_w % 8 == 0 && cell_h % 8 == 0)
+		encoders.add({ "cjpeg", "image/jpeg", PF_RGB,    0, 100, write_jpg_cells, false });
+	else
+		encoders.add({ "cjpeg", "image/jpeg", PF_YUV420, 0, 100, write_jpg,       false });
 }
 
 httpd * start_http_server(const std::string & bind_ip, const int http_port, http_server_parameters_t *const hsp, const std::optional<std::pair<std::string, std::string> > & tls_key_certificate)
 {
-	std::map<std::string, std::function<void (const std::string url, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > url_map;
+	static std::once_flag registered;
+	std::call_once(registered, register_encoders, hsp);
+
+	std::map<std::string, std::function<void (const std::string url, const std::map<std::string, std::string> & headers, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > url_map;
 
 	url_map.insert({ "/",             get_html_root });
 	url_map.insert({ "/index.html",   get_html_root });
-	url_map.insert({ "/frame.jpeg",   get_frame_jpeg });
-	url_map.insert({ "/frame.png",    get_frame_png });
-	url_map.insert({ "/frame.bmp",    get_frame_bmp });
-	url_map.insert({ "/frame.tga",    get_frame_tga });
-	url_map.insert({ "/stream.mjpeg", get_stream });
-	url_map.insert({ "/stream.mpng",  get_stream });
-	url_map.insert({ "/stream.mbmp",  get_stream });
-	url_map.insert({ "/stream.mtga",  get_stream });
-
-	cr.insert({ "jpg", new cached_renderer(write_jpg, hsp) });
-	cr.insert({ "png", new cached_renderer(write_png, hsp) });
-	cr.insert({ "bmp", new cached_renderer(write_bmp, hsp) });
-	cr.insert({ "tga", new cached_renderer(write_tga, hsp) });
+	url_map.insert({ "/stats.json",   get_stats });
+	url_map.insert({ "/frame",        get_frame });
+	url_map.insert({ "/stream",       get_stream });
+	url_map.insert({ "/delta.html",   get_delta_html });
+	url_map.insert({ "/delta.mpng",   get_delta_stream });
+	url_map.insert({ "/delta.mqoi",   get_delta_stream });
+	url_map.insert({ "/stream.gif",   get_animation_stream });
+	url_map.insert({ "/stream.apng",  get_animation_stream });
+	url_map.insert({ "/clip.gif",     get_clip });
+	url_map.insert({ "/clip.apng",    get_clip });
+#if defined(HAVE_X264)
+	url_map.insert({ "/stream.mp4",   get_h264_stream });
+#endif
+
+	for(auto & e: encoders.get_encoders()) {
+		url_map.insert({ "/frame."   + e.extension, get_frame });
+		url_map.insert({ "/stream.m" + e.extension, get_stream });
+	}
 
 	return new httpd(bind_ip, http_port, url_map, hsp, tls_key_certificate);
 }
@@ -260,8 +765,4 @@ httpd * start_http_server(const std::string & bind_ip, const int http_port, http
 void stop_http_server(httpd *const h)
 {
 	delete h;
-
-	for(auto & item: cr)
-		delete item.second;
-	cr.clear();
 }
@@ -1,11 +1,19 @@
+#include "encoded-cache.h"
+#include "frame-bus.h"
+#include "frame-history.h"
 #include "httpd.h"
 #include "terminal.h"
 
 
 typedef struct {
-	terminal *t;
-	int       compression_level;
-	int       max_wait;
+	terminal      *t;
+	frame_bus     *fb;
+	encoded_cache *ec;
+	int            compression_level;
+	int            max_wait;
+	int            keyframe_interval;  // delta streams, in seconds
+	frame_history *fh;                 // nullptr when clips are disabled
+	int            h264_crf;           // /stream.mp4 (when built with x264)
 } http_server_parameters_t;
 
 httpd * start_http_server(const std::string & bind_ip, const int http_port, http_server_parameters_t *const hsp, const std::optional<std::pair<std::string, std::string> > & tls_key_certificate);
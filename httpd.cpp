@@ -18,7 +18,7 @@
 #include "time.h"
 
 
-httpd::httpd(const std::string & bind_interface, const int bind_port, const std::map<std::string, std::function<void (const std::string, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > & url_map, const void *const parameters, const std::optional<std::pair<std::string, std::string> > tls_key_certificate) :
+httpd::httpd(const std::string & bind_interface, const int bind_port, const std::map<std::string, std::function<void (const std::string, const std::map<std::string, std::string> & headers, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > & url_map, const void *const parameters, const std::optional<std::pair<std::string, std::string> > tls_key_certificate) :
 	url_map(url_map),
 	parameters(parameters),
 	tls_key_certificate(tls_key_certificate)
@@ -85,7 +85,10 @@ void httpd::handle_request(net_io *const io, const std::string & endpoint)
 		return;
 	}
 
-	auto it = url_map.find(request.at(1));
+	// parameters (e.g. "?fps=5") are left for the handler to parse
+	const std::string path = request.at(1).substr(0, request.at(1).find('?'));
+
+	auto it = url_map.find(path);
 	if (it == url_map.end()) {
 		std::string reply = "HTTP/1.0 404 OK\r\n";
 
@@ -98,7 +101,17 @@ void httpd::handle_request(net_io *const io, const std::string & endpoint)
 
 	dolog(ll_info, "httpd::handle_request(%s): requested url %s", endpoint.c_str(), request.at(1).c_str());
 
-	it->second(request.at(1), io, parameters, stop_flag, request.at(0) == "HEAD");
+	// header names are case insensitive
+	std::map<std::string, std::string> headers;
+
+	for(size_t i=1; i<request_lines.size(); i++) {
+		std::size_t colon = request_lines.at(i).find(':');
+
+		if (colon != std::string::npos)
+			headers.insert({ str_tolower(trim(request_lines.at(i).substr(0, colon))), trim(request_lines.at(i).substr(colon + 1)) });
+	}
+
+	it->second(request.at(1), headers, io, parameters, stop_flag, request.at(0) == "HEAD");
 }
 
 void httpd::operator()()
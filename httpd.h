@@ -11,7 +11,7 @@
 class httpd
 {
 private:
-	const std::map<std::string, std::function<void (const std::string, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > url_map;
+	const std::map<std::string, std::function<void (const std::string, const std::map<std::string, std::string> & headers, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > url_map;
 	const void *const parameters { nullptr };
 
 	int               server_fd  { -1      };
@@ -23,7 +23,7 @@ private:
 	void handle_request(net_io *const io, const std::string & endpoint);
 
 public:
-	httpd(const std::string & bind_interface, const int bind_port, const std::map<std::string, std::function<void (const std::string, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > & url_map, const void *const parameters, const std::optional<std::pair<std::string, std::string> > tls_key_certificate);
+	httpd(const std::string & bind_interface, const int bind_port, const std::map<std::string, std::function<void (const std::string, const std::map<std::string, std::string> & headers, net_io *const io, const void *, std::atomic_bool & stop_flag, const bool peek)> > & url_map, const void *const parameters, const std::optional<std::pair<std::string, std::string> > tls_key_certificate);
 	virtual ~httpd();
 
 	void operator()();
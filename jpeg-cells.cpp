@@ -0,0 +1,498 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "error.h"
+#include "jpeg-cells.h"
+#include "stats.h"
+
+
+// at most this many blocks are remembered (~400 bytes each)
+#define JPEG_CELLS_CACHE_SIZE 32768
+
+static const uint8_t zigzag[64] {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// ITU T.81 annex K
+static const uint8_t base_quant[2][64] {
+	{
+		16, 11, 10, 16,  24,  40,  51,  61,
+		12, 12, 14, 19,  26,  58,  60,  55,
+		14, 13, 16, 24,  40,  57,  69,  56,
+		14, 17, 22, 29,  51,  87,  80,  62,
+		18, 22, 37, 56,  68, 109, 103,  77,
+		24, 35, 55, 64,  81, 104, 113,  92,
+		49, 64, 78, 87, 103, 121, 120, 101,
+		72, 92, 95, 98, 112, 100, 103,  99
+	},
+	{
+		17, 18, 24, 47, 99, 99, 99, 99,
+		18, 21, 26, 66, 99, 99, 99, 99,
+		24, 26, 56, 99, 99, 99, 99, 99,
+		47, 66, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99
+	}
+};
+
+static const uint8_t dc_bits[2][16] {
+	{ 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 }
+};
+
+static const uint8_t dc_values[12] { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t ac_bits[2][16] {
+	{ 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+	{ 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }
+};
+
+static const uint8_t ac_values[2][162] {
+	{
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	},
+	{
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+		0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+		0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+		0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+		0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+		0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	}
+};
+
+typedef struct {
+	uint16_t code[256];
+	uint8_t  size[256];
+} huffman_t;
+
+static void make_huffman(const uint8_t *const bits, const uint8_t *const values, huffman_t *const h)
+{
+	uint16_t code = 0;
+	int      k    = 0;
+
+	for(int length=1; length<=16; length++) {
+		for(int i=0; i<bits[length - 1]; i++, k++) {
+			h->code[values[k]] = code++;
+			h->size[values[k]] = length;
+		}
+
+		code <<= 1;
+	}
+}
+
+// MSB first, with 0xff stuffing when 'stuffing' is set
+class bit_writer
+{
+private:
+	std::vector<uint8_t> & out;
+	const bool stuffing { true };
+	uint64_t   acc      { 0 };
+	int        n        { 0 };
+
+	void put_byte(const uint8_t byte) {
+		out.push_back(byte);
+
+		if (byte == 0xff && stuffing)
+			out.push_back(0x00);
+	}
+
+public:
+	bit_writer(std::vector<uint8_t> & out, const bool stuffing) : out(out), stuffing(stuffing) {
+	}
+
+	int get_n_bits() const { return out.size() * 8 + n; }
+
+	// 'size' <= 32
+	void put(const uint32_t bits, const int size) {
+		acc = (acc << size) | (bits & ((1ull << size) - 1));
+		n  += size;
+
+		if (n >= 32) {
+			n -= 32;
+
+			put_byte(acc >> (n + 24));
+			put_byte(acc >> (n + 16));
+			put_byte(acc >> (n +  8));
+			put_byte(acc >>  n);
+		}
+	}
+
+	// append bits that were written by a non-stuffing bit_writer
+	void put(const std::vector<uint8_t> & bits, const int size) {
+		int i = 0;
+
+		for(; i + 4 <= size / 8; i += 4)
+			put(uint32_t(bits[i]) << 24 | uint32_t(bits[i + 1]) << 16 | uint32_t(bits[i + 2]) << 8 | bits[i + 3], 32);
+
+		for(; i < size / 8; i++)
+			put(bits[i], 8);
+
+		if (size & 7)
+			put(bits[i] >> (8 - (size & 7)), size & 7);
+	}
+
+	// pads with 1 bits
+	void flush() {
+		if (n & 7)
+			put(0x7f, 8 - (n & 7));
+
+		while(n) {
+			n -= 8;
+			put_byte(acc >> n);
+		}
+	}
+};
+
+// one 8x8 block of Y, Cb and Cr: the quantized DC coefficients and the
+// Huffman coded AC coefficients; only the former depend on the blocks in
+// front of it (DC prediction)
+typedef struct {
+	int16_t              dc[3];
+	std::vector<uint8_t> ac[3];
+	int                  ac_bits[3];
+} block_t;
+
+// blocks of all quality settings share the cache: the quality is part of
+// the key, so that clients with different settings do not evict each
+// other's blocks on every frame
+typedef struct {
+	std::mutex lock;
+	std::unordered_map<uint64_t, std::shared_ptr<const block_t> > blocks;
+} jpeg_cells_cache_t;
+
+static jpeg_cells_cache_t cache;
+
+static void make_quant_tables(const int quality, uint16_t (*const quant)[64])
+{
+	// IJG scaling
+	const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+	for(int t=0; t<2; t++) {
+		for(int i=0; i<64; i++)
+			quant[t][i] = std::max(1, std::min(255, (base_quant[t][i] * scale + 50) / 100));
+	}
+}
+
+static void forward_dct(const uint8_t *const rgb, const int stride, const uint16_t (*const quant_tables)[64], int16_t (*const out)[64])
+{
+	static float cosines[8][8];
+	static std::once_flag cosines_initialized;
+
+	std::call_once(cosines_initialized, [] {
+			for(int u=0; u<8; u++) {
+				for(int x=0; x<8; x++)
+					cosines[u][x] = (u == 0 ? sqrt(0.125) : 0.5) * cos((2 * x + 1) * u * M_PI / 16);
+			}
+		});
+
+	float component[3][64];
+
+	for(int y=0; y<8; y++) {
+		for(int x=0; x<8; x++) {
+			const uint8_t *p = &rgb[y * stride + x * 3];
+
+			component[0][y * 8 + x] =  0.299    * p[0] + 0.587    * p[1] + 0.114    * p[2] - 128;
+			component[1][y * 8 + x] = -0.168736 * p[0] - 0.331264 * p[1] + 0.5      * p[2];
+			component[2][y * 8 + x] =  0.5      * p[0] - 0.418688 * p[1] - 0.081312 * p[2];
+		}
+	}
+
+	for(int c=0; c<3; c++) {
+		float rows[64];
+
+		for(int y=0; y<8; y++) {
+			for(int u=0; u<8; u++) {
+				float sum = 0;
+				for(int x=0; x<8; x++)
+					sum += cosines[u][x] * component[c][y * 8 + x];
+				rows[y * 8 + u] = sum;
+			}
+		}
+
+		const uint16_t *quant = quant_tables[c != 0];
+
+		for(int k=0; k<64; k++) {
+			const int u = zigzag[k] % 8;
+			const int v = zigzag[k] / 8;
+
+			float sum = 0;
+			for(int y=0; y<8; y++)
+				sum += cosines[v][y] * rows[y * 8 + u];
+
+			out[c][k] = lroundf(sum / quant[zigzag[k]]);
+		}
+	}
+}
+
+static int n_bits(int v)
+{
+	v = abs(v);
+
+	int n = 0;
+	for(; v; v >>= 1)
+		n++;
+
+	return n;
+}
+
+static void encode_ac(bit_writer & bw, const int16_t *const coefficients, const huffman_t & ac)
+{
+	int run = 0;
+
+	for(int k=1; k<64; k++) {
+		const int v = coefficients[k];
+
+		if (v == 0) {
+			run++;
+			continue;
+		}
+
+		for(; run > 15; run -= 16)
+			bw.put(ac.code[0xf0], ac.size[0xf0]);  // ZRL
+
+		const int size   = n_bits(v);
+		const int symbol = (run << 4) | size;
+		bw.put(ac.code[symbol], ac.size[symbol]);
+		bw.put(v < 0 ? v - 1 : v, size);
+
+		run = 0;
+	}
+
+	if (run)
+		bw.put(ac.code[0x00], ac.size[0x00]);  // EOB
+}
+
+static void encode_dc(bit_writer & bw, const int dc_value, int *const dc_prediction, const huffman_t & dc)
+{
+	const int diff = dc_value - *dc_prediction;
+	*dc_prediction = dc_value;
+
+	const int size = n_bits(diff);
+	bw.put(dc.code[size], dc.size[size]);
+	if (size)
+		bw.put(diff < 0 ? diff - 1 : diff, size);
+}
+
+static void put_marker(std::vector<uint8_t> & out, const uint8_t marker, const size_t length)
+{
+	out.push_back(0xff);
+	out.push_back(marker);
+	out.push_back((length + 2) >> 8);
+	out.push_back(length + 2);
+}
+
+static void put_headers(std::vector<uint8_t> & out, const int ncols, const int nrows, const uint16_t (*const quant)[64])
+{
+	out.push_back(0xff);
+	out.push_back(0xd8);  // SOI
+
+	const uint8_t jfif[] { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	put_marker(out, 0xe0, sizeof jfif);
+	out.insert(out.end(), jfif, jfif + sizeof jfif);
+
+	put_marker(out, 0xdb, 2 * 65);  // DQT
+	for(int t=0; t<2; t++) {
+		out.push_back(t);
+		for(int k=0; k<64; k++)
+			out.push_back(quant[t][zigzag[k]]);
+	}
+
+	const uint8_t sof[] { 8, uint8_t(nrows >> 8), uint8_t(nrows), uint8_t(ncols >> 8), uint8_t(ncols), 3, 1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1 };
+	put_marker(out, 0xc0, sizeof sof);  // SOF0, no subsampling
+	out.insert(out.end(), sof, sof + sizeof sof);
+
+	put_marker(out, 0xc4, 2 * (1 + 16 + 12) + 2 * (1 + 16 + 162));  // DHT
+	for(int t=0; t<2; t++) {
+		out.push_back(0x00 | t);
+		out.insert(out.end(), dc_bits[t], dc_bits[t] + 16);
+		out.insert(out.end(), dc_values, dc_values + 12);
+
+		out.push_back(0x10 | t);
+		out.insert(out.end(), ac_bits[t], ac_bits[t] + 16);
+		out.insert(out.end(), ac_values[t], ac_values[t] + 162);
+	}
+
+	const uint8_t sos[] { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+	put_marker(out, 0xda, sizeof sos);
+	out.insert(out.end(), sos, sos + sizeof sos);
+}
+
+static uint64_t hash_block(const uint8_t *const rgb, const int stride, const int quality)
+{
+	uint64_t hash = (0xcbf29ce484222325ull ^ quality) * 0x9e3779b97f4a7c15ull;
+
+	for(int y=0; y<8; y++) {
+		for(int i=0; i<3; i++) {
+			uint64_t v;
+			memcpy(&v, &rgb[y * stride + i * 8], 8);
+
+			hash  = (hash ^ v) * 0x9e3779b97f4a7c15ull;
+			hash ^= hash >> 32;
+		}
+	}
+
+	return hash;
+}
+
+// the pixels of the 8x8 block at bx,by; partial blocks at the edges are
+// padded by repeating the last pixels (into 'edge')
+static const uint8_t *get_block(const int ncols, const int nrows, const uint8_t *const in, const int bx, const int by, uint8_t *const edge, int *const stride)
+{
+	if (bx + 8 > ncols || by + 8 > nrows) {
+		for(int y=0; y<8; y++) {
+			for(int x=0; x<8; x++)
+				memcpy(&edge[(y * 8 + x) * 3], &in[(std::min(by + y, nrows - 1) * ncols + std::min(bx + x, ncols - 1)) * 3], 3);
+		}
+
+		*stride = 8 * 3;
+
+		return edge;
+	}
+
+	*stride = ncols * 3;
+
+	return &in[(by * ncols + bx) * 3];
+}
+
+void write_jpg_cells(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
+{
+	const int quality = std::max(1, std::min(100, 100 - compression_level));
+
+	uint16_t quant[2][64];
+	make_quant_tables(quality, quant);
+
+	static huffman_t dc[2];
+	static huffman_t ac[2];
+	static std::once_flag tables_initialized;
+
+	std::call_once(tables_initialized, [] {
+			for(int t=0; t<2; t++) {
+				make_huffman(dc_bits[t], dc_values,    &dc[t]);
+				make_huffman(ac_bits[t], ac_values[t], &ac[t]);
+			}
+		});
+
+	const int blocks_w = (ncols + 7) / 8;
+	const int n_blocks = blocks_w * ((nrows + 7) / 8);
+
+	uint8_t edge[8 * 8 * 3];
+	int     stride = 0;
+
+	std::vector<uint64_t> hashes(n_blocks);
+	for(int i=0; i<n_blocks; i++) {
+		const uint8_t *pixels = get_block(ncols, nrows, in, i % blocks_w * 8, i / blocks_w * 8, edge, &stride);
+		hashes[i] = hash_block(pixels, stride, quality);
+	}
+
+	// the cache is locked only for looking up and adding blocks, not while
+	// transforming or entropy coding them
+	std::vector<std::shared_ptr<const block_t> > blocks(n_blocks);
+	std::vector<int> missing;
+
+	{
+		std::unique_lock<std::mutex> lck(cache.lock);
+
+		for(int i=0; i<n_blocks; i++) {
+			auto it = cache.blocks.find(hashes[i]);
+			if (it == cache.blocks.end())
+				missing.push_back(i);
+			else
+				blocks[i] = it->second;
+		}
+	}
+
+	std::unordered_map<uint64_t, std::shared_ptr<const block_t> > new_blocks;
+
+	for(int i: missing) {
+		auto it = new_blocks.find(hashes[i]);
+		if (it != new_blocks.end()) {
+			blocks[i] = it->second;
+			continue;
+		}
+
+		const uint8_t *pixels = get_block(ncols, nrows, in, i % blocks_w * 8, i / blocks_w * 8, edge, &stride);
+
+		int16_t coefficients[3][64];
+		forward_dct(pixels, stride, quant, coefficients);
+
+		auto b = std::make_shared<block_t>();
+
+		for(int c=0; c<3; c++) {
+			b->dc[c] = coefficients[c][0];
+
+			bit_writer ac_bw(b->ac[c], false);
+			encode_ac(ac_bw, coefficients[c], ac[c != 0]);
+			b->ac_bits[c] = ac_bw.get_n_bits();
+			ac_bw.flush();
+		}
+
+		blocks[i] = b;
+		new_blocks.insert({ hashes[i], std::move(b) });
+	}
+
+	if (new_blocks.empty() == false) {
+		std::unique_lock<std::mutex> lck(cache.lock);
+
+		if (cache.blocks.size() + new_blocks.size() > JPEG_CELLS_CACHE_SIZE)
+			cache.blocks.clear();
+
+		cache.blocks.insert(new_blocks.begin(), new_blocks.end());
+	}
+
+	std::vector<uint8_t> data;
+	data.reserve(64 * 1024);
+
+	put_headers(data, ncols, nrows, quant);
+
+	bit_writer bw(data, true);
+	int        dc_prediction[3] { };
+
+	for(auto & b: blocks) {
+		for(int c=0; c<3; c++) {
+			encode_dc(bw, b->dc[c], &dc_prediction[c], dc[c != 0]);
+			bw.put(b->ac[c], b->ac_bits[c]);
+		}
+	}
+
+	bw.flush();
+
+	data.push_back(0xff);
+	data.push_back(0xd9);  // EOI
+
+	stats.add("jpeg-cells-hits",   n_blocks - new_blocks.size());
+	stats.add("jpeg-cells-misses", new_blocks.size());
+
+	*out_len = data.size();
+	*out     = reinterpret_cast<uint8_t *>(malloc(data.size()));
+	if (!*out)
+		error_exit(true, "write_jpg_cells: cannot allocate %zu bytes", data.size());
+
+	memcpy(*out, data.data(), data.size());
+}
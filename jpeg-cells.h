@@ -0,0 +1,13 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+
+// experimental baseline JPEG (4:4:4) writer for RGB frames that keeps the
+// quantized DCT coefficients of every 8x8 block it has seen: when the
+// character cells are a multiple of 8 pixels wide and high, every block
+// lies within one cell, so the same glyph in the same colors gives the
+// same blocks and a frame is mostly entropy coding of cached coefficients
+void write_jpg_cells(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
@@ -21,7 +21,12 @@
 #include <wolfssl/options.h>
 #include <wolfssl/ssl.h>
 
+#include "encoded-cache.h"
 #include "error.h"
+#include "font-bitmap.h"
+#include "font-freetype.h"
+#include "frame-bus.h"
+#include "frame-history.h"
 #include "http.h"
 #include "io.h"
 #include "logging.h"
@@ -575,6 +580,8 @@ int main(int argc, char *argv[])
 		auto      font_width          = yaml_get_int_optional(config, "font-width");
 		const int font_height         = yaml_get_int(config,          "font-height", "font height (in pixels)");
 
+		const std::string font_backend= yaml_get_string_optional(config, "font-backend").value_or("freetype");
+
 		YAML::Node font_map           = yaml_get_yaml_node(config, "font-files", "TTF font file");
 
 		std::vector<std::string> font_files;
@@ -585,7 +592,19 @@ int main(int argc, char *argv[])
 			font_files.push_back(file);
 		}
 
-		font f(font_files, font_width, font_height);
+		font *f = nullptr;
+
+		if (font_backend == "freetype")
+			f = new font_freetype(font_files, font_width, font_height);
+		else if (font_backend == "bitmap") {
+			if (font_files.empty())
+				error_exit(false, "font-backend \"bitmap\" requires a PSF or BDF file in font-files");
+
+			f = new font_bitmap(font_files.at(0));
+		}
+		else {
+			error_exit(false, "font-backend \"%s\" is not known (use \"freetype\" or \"bitmap\")", font_backend.c_str());
+		}
 
 		const int width               = yaml_get_int(config,    "width",        "terminal console width (e.g. 80)");
 		const int height              = yaml_get_int(config,    "height",       "terminal console height (e.g. 25)");
@@ -612,6 +631,13 @@ int main(int argc, char *argv[])
 		}
 
 		const int minimum_fps         = yaml_get_int(config,    "minimum-fps",  "minimum number of frame per second; set to 0 to not control this");
+		const int maximum_fps         = yaml_get_int_optional(config, "maximum-fps").value_or(25);
+		const int keyframe_interval   = yaml_get_int_optional(config, "keyframe-interval").value_or(10);
+		const int clip_seconds        = yaml_get_int_optional(config, "clip-seconds").value_or(30);
+		const int clip_fps            = yaml_get_int_optional(config, "clip-fps").value_or(10);
+		const int h264_crf            = yaml_get_int_optional(config, "h264-crf").value_or(28);
+		const uint64_t clip_memory    = config["clip-memory"] ? yaml_get_uint64_t(config, "clip-memory", "memory limit of the frames kept for clips", true) : 64 * 1024 * 1024;
+		const uint64_t encoded_cache_size = config["encoded-cache-size"] ? yaml_get_uint64_t(config, "encoded-cache-size", "memory limit of the cache of encoded frames", true) : 16 * 1024 * 1024;
 
 		const int ssh_port            = yaml_get_int(config,    "ssh-port",     "SSH port for controlling the program (0 to disable)");
 		const std::string ssh_bind    = yaml_get_string(config, "ssh-addr",     "network interface (IP address) to let the SSH port bind to");
@@ -629,7 +655,7 @@ int main(int argc, char *argv[])
 		signal(SIGINT,  signal_handler);
 		signal(SIGPIPE, SIG_IGN);
 
-		terminal t(&f, width, height, &stop);
+		terminal t(f, width, height, &stop);
 
 		const std::string terminal_type = yaml_get_string(config, "terminal-type", "either \"xterm\", \"xterm-256color\" or \"ansi\"");
 		if (terminal_type != "xterm" && terminal_type != "xterm-256color" && terminal_type != "ansi")
@@ -660,9 +686,12 @@ int main(int argc, char *argv[])
 		auto proc             = exec_with_pipe(command, directory, width, height, restart_interval, stderr_to_stdout, terminal_type);
 		int  program_fd       = std::get<1>(proc);
 
+		frame_bus *fb = new frame_bus(&t, maximum_fps);
+		fb->begin();
+
 		VNCServer *vnc { nullptr };
 		if (vnc_port != 0) {
-			vnc = new VNCServer(&t, vnc_port, vnc_allow_keyboard, program_fd);
+			vnc = new VNCServer(&t, fb, vnc_port, vnc_allow_keyboard, program_fd);
 			vnc->begin();
 		}
 
@@ -682,10 +711,21 @@ int main(int argc, char *argv[])
 					process_ssh(&t, ssh_keys, ssh_bind, ssh_port, program_fd, dumb_telnet, ignore_keypresses, &clients);
 				});
 
+		encoded_cache ec(encoded_cache_size);
+
+		frame_history *fh = new frame_history(fb, clip_seconds, clip_fps, clip_memory);
+		if (clip_seconds > 0)
+			fh->begin();
+
 		http_server_parameters_t server_parameters { 0 };
 		server_parameters.t                 = &t;
+		server_parameters.fb                = fb;
+		server_parameters.ec                = &ec;
 		server_parameters.compression_level = compression_level;
 		server_parameters.max_wait          = minimum_fps > 0 ? 1000 / minimum_fps : 0;
+		server_parameters.keyframe_interval = keyframe_interval;
+		server_parameters.fh                = clip_seconds > 0 ? fh : nullptr;
+		server_parameters.h264_crf          = h264_crf;
 
 		httpd *s_h = { nullptr };
 		httpd *h   = { nullptr };
@@ -735,6 +775,13 @@ int main(int argc, char *argv[])
 		if (h)
 			stop_http_server(h);
 
+		// fh reads from fb and fb renders with the font, so in this order
+		delete fh;
+
+		delete fb;
+
+		delete f;
+
 		wolfSSL_Cleanup();
 	}
 	catch(const std::string & exception) {
@@ -1,13 +1,24 @@
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <png.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <tuple>
 #include <turbojpeg.h>
+#include <vector>
+#include <zlib.h>
 
 #include "error.h"
 #include "logging.h"
 #include "picio.h"
+#include "stats.h"
+#include "worker-pool.h"
 
 
 static void libpng_error_handler(png_structp png, png_const_charp msg)
@@ -20,14 +31,300 @@ static void libpng_warning_handler(png_structp png, png_const_charp msg)
 	printf("libpng warning: %s\n", msg);
 }
 
-void write_PNG_file(FILE *const fh, const int ncols, const int nrows, const int compression_level, uint8_t *pixels)
+typedef struct {
+	uint8_t *data;
+	size_t   len;
+	size_t   size;
+} png_memory_t;
+
+static void png_memory_write(png_structp png, png_bytep data, png_size_t len)
 {
-	png_bytep *row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * nrows);
-	if (!row_pointers)
-		error_exit(true, "write_PNG_file error allocating row-pointers");
+	png_memory_t *m = reinterpret_cast<png_memory_t *>(png_get_io_ptr(png));
 
-	for(int y=0; y<nrows; y++)
-		row_pointers[y] = &pixels[y*ncols*3];
+	if (m->len + len > m->size) {
+		m->size = std::max(m->size * 2, m->len + len);
+		m->data = reinterpret_cast<uint8_t *>(realloc(m->data, m->size));
+		if (!m->data)
+			error_exit(true, "png_memory_write: cannot allocate %zu bytes", m->size);
+	}
+
+	memcpy(&m->data[m->len], data, len);
+	m->len += len;
+}
+
+static void png_memory_flush(png_structp png)
+{
+}
+
+// terminal frames rarely have more than a few colors: returns an indexed
+// copy of 'pixels' and its palette when there are at most 256
+static bool make_indexed(const int ncols, const int nrows, const uint8_t *const pixels, uint8_t *const indexed, png_color *const palette, int *const n_colors)
+{
+	// open addressing; a slot is 0 when empty, else 1 << 32 | rgb << 8 | index
+	uint64_t slots[1024] { };
+	uint32_t prev_rgb   = 0xffffffff;
+	uint8_t  prev_index = 0;
+
+	*n_colors = 0;
+
+	for(int i=0; i<ncols * nrows; i++) {
+		const uint8_t *p   = &pixels[i * 3];
+		uint32_t       rgb = (p[0] << 16) | (p[1] << 8) | p[2];
+
+		// long runs of the same color (background) are the common case
+		if (rgb == prev_rgb) {
+			indexed[i] = prev_index;
+			continue;
+		}
+
+		uint32_t slot = (rgb * 2654435761u) >> 22;
+
+		while(slots[slot] && ((slots[slot] >> 8) & 0xffffff) != rgb)
+			slot = (slot + 1) & 1023;
+
+		if (slots[slot] == 0) {
+			if (*n_colors == 256)
+				return false;
+
+			palette[*n_colors] = { p[0], p[1], p[2] };
+			slots[slot] = 1ull << 32 | uint64_t(rgb) << 8 | *n_colors;
+			(*n_colors)++;
+		}
+
+		prev_rgb   = rgb;
+		prev_index = slots[slot] & 0xff;
+		indexed[i] = prev_index;
+	}
+
+	return true;
+}
+
+// raw image data per block of rows when deflating in parallel; smaller
+// blocks do not win enough to make up for the overhead
+#define PNG_PARALLEL_BLOCK_SIZE (256 * 1024)
+
+static void put_be32(uint8_t *const p, const uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static size_t png_put_chunk(uint8_t *const p, const char *const type, const uint8_t *const data, const size_t len)
+{
+	put_be32(&p[0], len);
+	memcpy(&p[4], type, 4);
+	if (len)
+		memcpy(&p[8], data, len);
+	put_be32(&p[8 + len], crc32(crc32(0, &p[4], 4), data, len));
+
+	return len + 12;
+}
+
+// filters rows [y_start, y_end) (packed already) with NONE or SUB, whichever
+// gives the smallest sum of absolute values; 'bpp' is bytes per pixel
+static void png_filter_rows(const uint8_t *const rows, const size_t row_bytes, const int bpp, const int y_start, const int y_end, const bool filter, std::vector<uint8_t> *const out)
+{
+	std::vector<uint8_t> sub(row_bytes);
+
+	for(int y=y_start; y<y_end; y++) {
+		const uint8_t *row = &rows[y * row_bytes];
+
+		uint64_t sum_none = 0;
+		uint64_t sum_sub  = 0;
+
+		if (filter) {
+			for(size_t x=0; x<row_bytes; x++) {
+				sub[x]    = row[x] - (x >= size_t(bpp) ? row[x - bpp] : 0);
+				sum_none += std::abs(int8_t(row[x]));
+				sum_sub  += std::abs(int8_t(sub[x]));
+			}
+		}
+
+		if (filter && sum_sub < sum_none) {
+			out->push_back(PNG_FILTER_VALUE_SUB);
+			out->insert(out->end(), sub.begin(), sub.end());
+		}
+		else {
+			out->push_back(PNG_FILTER_VALUE_NONE);
+			out->insert(out->end(), row, row + row_bytes);
+		}
+	}
+}
+
+typedef struct {
+	int                  y_start;
+	int                  y_end;
+	std::vector<uint8_t> compressed;
+	uLong                adler;
+	size_t               len;  // of the filtered data
+} png_block_t;
+
+// pigz-style: each block of rows is deflated separately (primed with the
+// 32kB before it) and ends on a byte boundary (sync flush) so that the
+// blocks can be concatenated into one zlib stream
+static void png_deflate_block(const uint8_t *const rows, const size_t row_bytes, const int bpp, const int level, const bool last, png_block_t *const b)
+{
+	std::vector<uint8_t> dictionary;
+	int y_dictionary = std::max(0, b->y_start - int((32768 + row_bytes) / (row_bytes + 1)));
+	png_filter_rows(rows, row_bytes, bpp, y_dictionary, b->y_start, true, &dictionary);
+
+	std::vector<uint8_t> filtered;
+	png_filter_rows(rows, row_bytes, bpp, b->y_start, b->y_end, true, &filtered);
+
+	b->adler = adler32(adler32(0, nullptr, 0), filtered.data(), filtered.size());
+	b->len   = filtered.size();
+
+	z_stream zs { };
+	if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		error_exit(false, "png_deflate_block: deflateInit2 failed");
+
+	if (dictionary.empty() == false) {
+		size_t dictionary_size = std::min(dictionary.size(), size_t(32768));
+		deflateSetDictionary(&zs, &dictionary[dictionary.size() - dictionary_size], dictionary_size);
+	}
+
+	b->compressed.resize(deflateBound(&zs, filtered.size()) + 16);
+
+	zs.next_in   = filtered.data();
+	zs.avail_in  = filtered.size();
+	zs.next_out  = b->compressed.data();
+	zs.avail_out = b->compressed.size();
+
+	if (deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH) == Z_STREAM_ERROR || zs.avail_in)
+		error_exit(false, "png_deflate_block: deflate failed");
+
+	b->compressed.resize(b->compressed.size() - zs.avail_out);
+
+	deflateEnd(&zs);
+}
+
+static void write_PNG_parallel(const int ncols, const int nrows, const int compression_level, const int n_blocks, const uint8_t *const pixels, const bool is_indexed, const uint8_t *const indexed, const png_color *const palette, const int n_colors, uint8_t **const out, size_t *const out_len)
+{
+	const int bit_depth = is_indexed ? (n_colors <= 2 ? 1 : (n_colors <= 4 ? 2 : (n_colors <= 16 ? 4 : 8))) : 8;
+	const size_t row_bytes = is_indexed ? (ncols * bit_depth + 7) / 8 : ncols * 3;
+	const int    bpp       = is_indexed ? 1 : 3;
+
+	// pack the palette indexes to the bit depth
+	std::vector<uint8_t> packed;
+	const uint8_t *rows = pixels;
+
+	if (is_indexed) {
+		packed.resize(row_bytes * nrows);
+
+		for(int y=0; y<nrows; y++) {
+			for(int x=0; x<ncols; x++) {
+				const int bit = x * bit_depth;
+				packed[y * row_bytes + bit / 8] |= indexed[y * ncols + x] << (8 - bit_depth - bit % 8);
+			}
+		}
+
+		rows = packed.data();
+	}
+
+	const int level = compression_level * 9 / 100;
+
+	std::vector<png_block_t> blocks(n_blocks);
+	std::vector<std::function<void()> > work;
+
+	for(int i=0; i<n_blocks; i++) {
+		blocks[i].y_start = nrows * i / n_blocks;
+		blocks[i].y_end   = nrows * (i + 1) / n_blocks;
+
+		work.push_back([rows, row_bytes, bpp, level, i, n_blocks, &blocks] { png_deflate_block(rows, row_bytes, bpp, level, i == n_blocks - 1, &blocks[i]); });
+	}
+
+	get_encode_pool().run(work);
+
+	// zlib header, the blocks and the adler32 of all filtered data
+	size_t idat_len = 2 + 4;
+	uLong  adler    = adler32(0, nullptr, 0);
+
+	for(auto & b: blocks) {
+		idat_len += b.compressed.size();
+		adler     = adler32_combine(adler, b.adler, b.len);
+	}
+
+	const char author[] = "Author\0termcamng";
+	const char url[]    = "URL\0https://github.com/folkertvanheusden/termcamng";
+
+	*out_len = 8 + (12 + 13) + (12 + n_colors * 3) * is_indexed + (12 + sizeof(author) - 1) + (12 + sizeof(url) - 1) + (12 + idat_len) + 12;
+	*out     = reinterpret_cast<uint8_t *>(malloc(*out_len));
+	if (!*out)
+		error_exit(true, "write_PNG_parallel: cannot allocate %zu bytes", *out_len);
+
+	uint8_t *p = *out;
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+	memcpy(p, signature, sizeof signature);
+	p += sizeof signature;
+
+	uint8_t ihdr[13] { };
+	put_be32(&ihdr[0], ncols);
+	put_be32(&ihdr[4], nrows);
+	ihdr[8] = bit_depth;
+	ihdr[9] = is_indexed ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB;
+	p += png_put_chunk(p, "IHDR", ihdr, sizeof ihdr);
+
+	if (is_indexed) {
+		uint8_t plte[256 * 3];
+		for(int i=0; i<n_colors; i++) {
+			plte[i * 3 + 0] = palette[i].red;
+			plte[i * 3 + 1] = palette[i].green;
+			plte[i * 3 + 2] = palette[i].blue;
+		}
+		p += png_put_chunk(p, "PLTE", plte, n_colors * 3);
+	}
+
+	p += png_put_chunk(p, "tEXt", reinterpret_cast<const uint8_t *>(author), sizeof(author) - 1);
+	p += png_put_chunk(p, "tEXt", reinterpret_cast<const uint8_t *>(url),    sizeof(url)    - 1);
+
+	// IDAT, filled in place: length, type, data, crc
+	uint8_t *idat = p;
+	put_be32(&idat[0], idat_len);
+	memcpy(&idat[4], "IDAT", 4);
+
+	uint8_t *d = &idat[8];
+	*d++ = 0x78;  // deflate, 32kB window
+	*d++ = 0x9c;
+	for(auto & b: blocks) {
+		memcpy(d, b.compressed.data(), b.compressed.size());
+		d += b.compressed.size();
+	}
+	put_be32(d, adler);
+	d += 4;
+
+	put_be32(d, crc32(0, &idat[4], 4 + idat_len));
+	p = d + 4;
+
+	p += png_put_chunk(p, "IEND", nullptr, 0);
+
+	assert(size_t(p - *out) == *out_len);
+}
+
+static void write_PNG_memory(const int ncols, const int nrows, const int compression_level, const uint8_t *const pixels, uint8_t **const out, size_t *const out_len)
+{
+	std::vector<uint8_t> indexed(ncols * nrows);
+	png_color            palette[256];
+	int                  n_colors = 0;
+	bool                 is_indexed = make_indexed(ncols, nrows, pixels, indexed.data(), palette, &n_colors);
+
+	// large images are deflated on all cores
+	const size_t raw_size = size_t(nrows) * (is_indexed ? ncols : ncols * 3);
+	const int    n_blocks = std::min(std::min(get_encode_pool().get_n_threads(), nrows), int(raw_size / PNG_PARALLEL_BLOCK_SIZE));
+
+	if (compression_level > 0 && n_blocks >= 2) {
+		write_PNG_parallel(ncols, nrows, compression_level, n_blocks, pixels, is_indexed, indexed.data(), palette, n_colors, out, out_len);
+		return;
+	}
+
+	// start with the size of the previous image to (mostly) avoid reallocs
+	thread_local size_t size_hint = 4096;
+
+	png_memory_t m { reinterpret_cast<uint8_t *>(malloc(size_hint)), 0, size_hint };
+	if (!m.data)
+		error_exit(true, "write_PNG_memory: cannot allocate %zu bytes", size_hint);
 
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, libpng_error_handler, libpng_warning_handler);
 	if (!png)
@@ -37,11 +334,23 @@ void write_PNG_file(FILE *const fh, const int ncols, const int nrows, const int
 	if (info == nullptr)
 		error_exit(false, "png_create_info_struct failed");
 
-	png_init_io(png, fh);
+	png_set_write_fn(png, &m, png_memory_write, png_memory_flush);
 
 	png_set_compression_level(png, compression_level * 9 / 100);
 
-	png_set_IHDR(png, info, ncols, nrows, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	// trying all filters costs a lot of time while text compresses best
+	// with none (or sub for anti-aliased glyphs)
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, compression_level == 0 ? PNG_FILTER_NONE : PNG_FILTER_NONE | PNG_FILTER_SUB);
+
+	if (is_indexed) {
+		const int bit_depth = n_colors <= 2 ? 1 : (n_colors <= 4 ? 2 : (n_colors <= 16 ? 4 : 8));
+
+		png_set_IHDR(png, info, ncols, nrows, bit_depth, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_set_PLTE(png, info, palette, n_colors);
+	}
+	else {
+		png_set_IHDR(png, info, ncols, nrows, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	}
 
 	png_text text_ptr[2] { };
 	text_ptr[0].key         = png_charp("Author");
@@ -54,12 +363,21 @@ void write_PNG_file(FILE *const fh, const int ncols, const int nrows, const int
 
 	png_write_info(png, info);
 
-	png_write_image(png, row_pointers);
+	// indexes are one byte each; libpng packs them to the bit depth
+	if (is_indexed)
+		png_set_packing(png);
+
+	for(int y=0; y<nrows; y++)
+		png_write_row(png, is_indexed ? &indexed[y * ncols] : &pixels[y * ncols * 3]);
+
 	png_write_end(png, nullptr);
 
 	png_destroy_write_struct(&png, &info);
 
-	free(row_pointers);
+	size_hint = m.len;
+
+	*out     = m.data;
+	*out_len = m.len;
 }
 
 class myjpeg
@@ -71,7 +389,9 @@ public:
        myjpeg();
        virtual ~myjpeg();
 
-       bool write_JPEG_memory(const int ncols, const int nrows, const int compression_level, const uint8_t *const pixels, uint8_t **out, size_t *out_len);
+       bool write_JPEG_memory(const int ncols, const int nrows, const int compression_level, const uint8_t *const yuv420, uint8_t **out, size_t *out_len);
+       // rows [y, y + h) of a frame of 'nrows' rows; 'y' is a multiple of 16
+       bool write_JPEG_stripe(const int ncols, const int nrows, const int y, const int h, const int compression_level, const uint8_t *const yuv420, uint8_t **out, size_t *out_len);
 };
 
 thread_local myjpeg my_jpeg;
@@ -86,11 +406,14 @@ myjpeg::~myjpeg()
 	tjDestroy(jpegCompressor);
 }
 
-bool myjpeg::write_JPEG_memory(const int ncols, const int nrows, const int compression_level, const uint8_t *const pixels, uint8_t **out, size_t *out_len)
+bool myjpeg::write_JPEG_memory(const int ncols, const int nrows, const int compression_level, const uint8_t *const yuv420, uint8_t **out, size_t *out_len)
 {
 	unsigned long int len = 0;
 
-	if (tjCompress2(jpegCompressor, pixels, ncols, 0, nrows, TJPF_RGB, out, &len, TJSAMP_444, 100 - compression_level, TJFLAG_FASTDCT) == -1) {
+	// the frame is already in YUV so turbojpeg can skip its color conversion
+	const uint8_t *planes[3] { yuv420, yuv420 + ncols * nrows, yuv420 + ncols * nrows + ((ncols + 1) / 2) * ((nrows + 1) / 2) };
+
+	if (tjCompressFromYUVPlanes(jpegCompressor, planes, ncols, nullptr, nrows, TJSAMP_420, out, &len, 100 - compression_level, TJFLAG_FASTDCT) == -1) {
 		dolog(ll_error, "Failed compressing frame: %s (%dx%d @ %d)", tjGetErrorStr(), ncols, nrows, compression_level);
 		return false;
 	}
@@ -100,22 +423,276 @@ bool myjpeg::write_JPEG_memory(const int ncols, const int nrows, const int compr
 	return true;
 }
 
+bool myjpeg::write_JPEG_stripe(const int ncols, const int nrows, const int y, const int h, const int compression_level, const uint8_t *const yuv420, uint8_t **out, size_t *out_len)
+{
+	unsigned long int len = 0;
+
+	const int      chroma_w = (ncols + 1) / 2;
+	const uint8_t *u        = yuv420 + ncols * nrows;
+	const uint8_t *v        = u + chroma_w * ((nrows + 1) / 2);
+
+	const uint8_t *planes [3] { yuv420 + y * ncols, u + y / 2 * chroma_w, v + y / 2 * chroma_w };
+	const int      strides[3] { ncols, chroma_w, chroma_w };
+
+	if (tjCompressFromYUVPlanes(jpegCompressor, planes, ncols, strides, h, TJSAMP_420, out, &len, 100 - compression_level, TJFLAG_FASTDCT) == -1) {
+		dolog(ll_error, "Failed compressing stripe: %s (%dx%d @ %d)", tjGetErrorStr(), ncols, h, compression_level);
+		return false;
+	}
+
+	*out_len = len;
+
+	return true;
+}
+
+// the height of an MCU with 4:2:0 subsampling
+#define JPEG_MCU_ROWS 16
+
+// finds the SOS segment and the entropy coded data behind it in a
+// turbojpeg JPEG (EOI follows the scan)
+static bool jpeg_find_scan(const uint8_t *const data, const size_t len, size_t *const sos_start, size_t *const scan_start)
+{
+	size_t offset = 2;  // SOI
+
+	while(offset + 4 <= len && data[offset] == 0xff) {
+		const uint8_t marker = data[offset + 1];
+		const size_t  length = (data[offset + 2] << 8) | data[offset + 3];
+
+		if (marker == 0xda) {  // SOS
+			*sos_start  = offset;
+			*scan_start = offset + 2 + length;
+
+			return *scan_start + 2 <= len && data[len - 2] == 0xff && data[len - 1] == 0xd9;
+		}
+
+		offset += 2 + length;
+	}
+
+	return false;
+}
+
+// four independent lanes keep the multiplier busy
+static uint64_t hash_bytes(uint64_t hash, const uint8_t *p, size_t n)
+{
+	uint64_t lanes[4] { hash, hash + 1, hash + 2, hash + 3 };
+
+	for(; n >= 32; p += 32, n -= 32) {
+		for(int i=0; i<4; i++) {
+			uint64_t v;
+			memcpy(&v, &p[i * 8], 8);
+
+			lanes[i]  = (lanes[i] ^ v) * 0x9e3779b97f4a7c15ull;
+			lanes[i] ^= lanes[i] >> 32;
+		}
+	}
+
+	hash = lanes[0];
+	for(int i=1; i<4; i++)
+		hash = (hash ^ lanes[i]) * 0x9e3779b97f4a7c15ull;
+
+	for(; n; p++, n--)
+		hash = (hash ^ *p) * 0x100000001b3ull;
+
+	return hash;
+}
+
+// the scan of one band of MCU rows and a hash of the pixels it encodes
+typedef struct {
+	uint64_t             hash;
+	std::vector<uint8_t> scan;
+} jpeg_band_t;
+
+// the previous JPEG of a given size and quality, per band
+typedef struct {
+	std::mutex               lock;
+	std::vector<uint8_t>     header;  // SOI up to SOS
+	std::vector<uint8_t>     sos;
+	std::vector<jpeg_band_t> bands;
+} jpeg_band_cache_t;
+
+static std::mutex jpeg_band_caches_lock;
+static std::map<std::tuple<int, int, int>, std::shared_ptr<jpeg_band_cache_t> > jpeg_band_caches;
+
+static std::shared_ptr<jpeg_band_cache_t> get_jpeg_band_cache(const int ncols, const int nrows, const int compression_level)
+{
+	std::unique_lock<std::mutex> lck(jpeg_band_caches_lock);
+
+	auto key = std::make_tuple(ncols, nrows, compression_level);
+	auto it  = jpeg_band_caches.find(key);
+	if (it != jpeg_band_caches.end())
+		return it->second;
+
+	// only a few are in use at the same time (one per compression level)
+	if (jpeg_band_caches.size() >= 8)
+		jpeg_band_caches.clear();
+
+	auto cache = std::make_shared<jpeg_band_cache_t>();
+	jpeg_band_caches.insert({ key, cache });
+
+	return cache;
+}
+
+// every band of 16 rows is encoded on its own and ends in a restart marker
+// (which also resets DC prediction), so that the scan of a band that did
+// not change since the previous frame can be reused as-is; changed bands
+// are encoded on all cores
+static bool write_JPEG_banded(const int ncols, const int nrows, const int compression_level, const uint8_t *const yuv420, uint8_t **const out, size_t *const out_len)
+{
+	auto cache = get_jpeg_band_cache(ncols, nrows, compression_level);
+
+	std::unique_lock<std::mutex> lck(cache->lock);
+
+	const int n_bands  = (nrows + JPEG_MCU_ROWS - 1) / JPEG_MCU_ROWS;
+	const int chroma_w = (ncols + 1) / 2;
+	const int chroma_h = (nrows + 1) / 2;
+
+	cache->bands.resize(n_bands);
+
+	std::vector<int> changed;
+
+	for(int i=0; i<n_bands; i++) {
+		const int y = i * JPEG_MCU_ROWS;
+		const int h = std::min(JPEG_MCU_ROWS, nrows - y);
+
+		const uint8_t *u = yuv420 + ncols * nrows;
+		const uint8_t *v = u + chroma_w * chroma_h;
+		const size_t   chroma_len = chroma_w * ((h + 1) / 2);
+
+		uint64_t hash = hash_bytes(0xcbf29ce484222325ull, yuv420 + y * ncols, h * ncols);
+		hash = hash_bytes(hash, u + y / 2 * chroma_w, chroma_len);
+		hash = hash_bytes(hash, v + y / 2 * chroma_w, chroma_len);
+
+		if (cache->bands[i].scan.empty() || cache->bands[i].hash != hash) {
+			cache->bands[i].hash = hash;
+			changed.push_back(i);
+		}
+	}
+
+	stats.add("jpeg-bands-reused",  n_bands - changed.size());
+	stats.add("jpeg-bands-encoded", changed.size());
+
+	if (changed.empty() == false) {
+		std::vector<std::pair<uint8_t *, size_t> > encoded(changed.size());
+		std::atomic_bool ok { true };
+
+		const int n_jobs = std::min(size_t(get_encode_pool().get_n_threads()), changed.size());
+		std::vector<std::function<void()> > work;
+
+		for(int j=0; j<n_jobs; j++) {
+			work.push_back([ncols, nrows, compression_level, yuv420, j, n_jobs, &changed, &encoded, &ok] {
+					for(size_t k=changed.size() * j / n_jobs; k<changed.size() * (j + 1) / n_jobs; k++) {
+						const int y = changed[k] * JPEG_MCU_ROWS;
+						const int h = std::min(JPEG_MCU_ROWS, nrows - y);
+
+						if (my_jpeg.write_JPEG_stripe(ncols, nrows, y, h, compression_level, yuv420, &encoded[k].first, &encoded[k].second) == false)
+							ok = false;
+					}
+				});
+		}
+
+		if (n_jobs == 1)
+			work[0]();
+		else
+			get_encode_pool().run(work);
+
+		for(size_t k=0; k<changed.size() && ok; k++) {
+			size_t sos_start  = 0;
+			size_t scan_start = 0;
+
+			if (jpeg_find_scan(encoded[k].first, encoded[k].second, &sos_start, &scan_start) == false) {
+				dolog(ll_error, "write_JPEG_banded: band %d is not a baseline JPEG", changed[k]);
+				ok = false;
+				break;
+			}
+
+			// all bands have the same tables; only the height in SOF differs
+			if (cache->header.empty()) {
+				cache->header.assign(encoded[k].first, encoded[k].first + sos_start);
+				cache->sos.assign(encoded[k].first + sos_start, encoded[k].first + scan_start);
+			}
+
+			cache->bands[changed[k]].scan.assign(encoded[k].first + scan_start, encoded[k].first + encoded[k].second - 2);
+		}
+
+		for(auto & e: encoded)
+			tjFree(e.first);
+
+		if (ok == false) {
+			cache->bands.clear();
+			return false;
+		}
+	}
+
+	// headers with the height of the whole frame and a restart interval of
+	// one band, then the scans of all bands separated by RSTn markers
+	size_t total_len = cache->header.size() + 6 + cache->sos.size();
+	for(auto & band: cache->bands)
+		total_len += band.scan.size() + 2;
+
+	*out = reinterpret_cast<uint8_t *>(malloc(total_len));
+	if (!*out)
+		error_exit(true, "write_JPEG_banded: cannot allocate %zu bytes", total_len);
+
+	uint8_t *p = *out;
+
+	memcpy(p, cache->header.data(), cache->header.size());
+
+	for(size_t offset = 2; offset + 4 <= cache->header.size();) {
+		const size_t length = (p[offset + 2] << 8) | p[offset + 3];
+
+		if (p[offset + 1] == 0xc0) {  // SOF0: precision, height, width
+			p[offset + 5] = nrows >> 8;
+			p[offset + 6] = nrows;
+		}
+
+		offset += 2 + length;
+	}
+
+	p += cache->header.size();
+
+	const int restart_interval = (ncols + JPEG_MCU_ROWS - 1) / JPEG_MCU_ROWS;
+
+	*p++ = 0xff;
+	*p++ = 0xdd;  // DRI
+	*p++ = 0x00;
+	*p++ = 0x04;
+	*p++ = restart_interval >> 8;
+	*p++ = restart_interval;
+
+	memcpy(p, cache->sos.data(), cache->sos.size());
+	p += cache->sos.size();
+
+	for(int i=0; i<n_bands; i++) {
+		memcpy(p, cache->bands[i].scan.data(), cache->bands[i].scan.size());
+		p += cache->bands[i].scan.size();
+
+		*p++ = 0xff;
+		*p++ = i == n_bands - 1 ? 0xd9 : 0xd0 + i % 8;  // EOI or RSTn
+	}
+
+	*out_len = p - *out;
+
+	assert(*out_len == total_len);
+
+	return true;
+}
+
 void write_png(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
 {
-	FILE *fh = open_memstream(reinterpret_cast<char **>(out), out_len);
-	write_PNG_file(fh, ncols, nrows, compression_level, const_cast<uint8_t *>(in));
-	fclose(fh);
+	write_PNG_memory(ncols, nrows, compression_level, in, out, out_len);
 }
 
 void write_jpg(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
 {
+	if (nrows >= 2 * JPEG_MCU_ROWS && write_JPEG_banded(ncols, nrows, compression_level, in, out, out_len))
+		return;
+
 	my_jpeg.write_JPEG_memory(ncols, nrows, compression_level, in, out, out_len);
 }
 
 void write_bmp(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
 {
 	*out_len = ncols * nrows * 3 + 2 + 12 + 40;
-	*out = new uint8_t[*out_len];
+	*out = reinterpret_cast<uint8_t *>(malloc(*out_len));
 
 	size_t offset = 0;
 	(*out)[offset++] = 'B';
@@ -175,21 +752,17 @@ void write_bmp(const int ncols, const int nrows, const int compression_level, co
 	(*out)[offset++] = 0x00;
 	assert(offset == 40 + 12 + 2);
 
+	// BMP is bottom to top
 	for(int y=nrows - 1; y >= 0; y--) {
-		size_t in_o = y * ncols * 3;
-		for(int x=0; x<ncols; x++) {
-			size_t in_o2 = in_o + x * 3;
-			(*out)[offset++] = in[in_o2 + 2];
-			(*out)[offset++] = in[in_o2 + 1];
-			(*out)[offset++] = in[in_o2 + 0];
-		}
+		memcpy(&(*out)[offset], &in[y * ncols * 3], ncols * 3);
+		offset += ncols * 3;
 	}
 }
 
 void write_tga(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
 {
 	*out_len = ncols * nrows * 3 + 18;
-	*out = new uint8_t[*out_len];
+	*out = reinterpret_cast<uint8_t *>(calloc(1, *out_len));
 
 	size_t offset = 0;
 	(*out)[offset++] = 0;  // id length
@@ -206,17 +779,188 @@ void write_tga(const int ncols, const int nrows, const int compression_level, co
 	(*out)[offset++] = nrows >> 8;  // height
 	(*out)[offset++] = 24;  // bit per pixel
 	(*out)[offset++] = 32;  // top to bottom
-	for(size_t i=0; i<nrows * ncols * 3; i += 3) {
-		(*out)[offset++] = in[i + 18 + 2];
-		(*out)[offset++] = in[i + 18 + 1];
-		(*out)[offset++] = in[i + 18 + 0];
+	memcpy(&(*out)[offset], in, ncols * nrows * 3);
+}
+
+// see https://qoiformat.org/qoi-specification.pdf
+void write_qoi(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
+{
+	const size_t n_pixels = size_t(ncols) * nrows;
+
+	// worst case: QOI_OP_RGB for every pixel
+	*out = reinterpret_cast<uint8_t *>(malloc(14 + n_pixels * 4 + 8));
+	if (!*out)
+		error_exit(true, "write_qoi: cannot allocate %zu bytes", 14 + n_pixels * 4 + 8);
+
+	uint8_t *p = *out;
+
+	memcpy(p, "qoif", 4);
+	put_be32(&p[4], ncols);
+	put_be32(&p[8], nrows);
+	p[12] = 3;  // RGB
+	p[13] = 0;  // sRGB with linear alpha
+	p += 14;
+
+	uint32_t index[64];  // 0xrrggbb of recently seen pixels
+	std::fill(std::begin(index), std::end(index), 0xff000000);  // matches no pixel
+	uint32_t prev = 0x000000;
+	int      run  = 0;
+
+	for(size_t i=0; i<n_pixels; i++) {
+		const uint8_t r = in[i * 3 + 0];
+		const uint8_t g = in[i * 3 + 1];
+		const uint8_t b = in[i * 3 + 2];
+		const uint32_t px = (r << 16) | (g << 8) | b;
+
+		if (px == prev) {
+			run++;
+
+			if (run == 62 || i == n_pixels - 1) {
+				*p++ = 0xc0 | (run - 1);  // QOI_OP_RUN
+				run  = 0;
+			}
+
+			continue;
+		}
+
+		if (run) {
+			*p++ = 0xc0 | (run - 1);
+			run  = 0;
+		}
+
+		const int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+
+		if (index[hash] == px) {
+			*p++ = hash;  // QOI_OP_INDEX
+		}
+		else {
+			index[hash] = px;
+
+			const int8_t dr = r - (prev >> 16);
+			const int8_t dg = g - ((prev >> 8) & 0xff);
+			const int8_t db = b - (prev & 0xff);
+
+			const int8_t dr_dg = dr - dg;
+			const int8_t db_dg = db - dg;
+
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+				*p++ = 0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);  // QOI_OP_DIFF
+			}
+			else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+				*p++ = 0x80 | (dg + 32);  // QOI_OP_LUMA
+				*p++ = (dr_dg + 8) << 4 | (db_dg + 8);
+			}
+			else {
+				*p++ = 0xfe;  // QOI_OP_RGB
+				*p++ = r;
+				*p++ = g;
+				*p++ = b;
+			}
+		}
+
+		prev = px;
 	}
+
+	const uint8_t end_marker[] { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(p, end_marker, sizeof end_marker);
+	p += sizeof end_marker;
+
+	*out_len = p - *out;
+	*out     = reinterpret_cast<uint8_t *>(realloc(*out, *out_len));
+}
+
+bool read_qoi(const uint8_t *const in, const size_t in_len, int *const ncols, int *const nrows, uint8_t **const out)
+{
+	if (in_len < 14 + 8 || memcmp(in, "qoif", 4) != 0)
+		return false;
+
+	*ncols = (in[4] << 24) | (in[5] << 16) | (in[6] << 8) | in[7];
+	*nrows = (in[8] << 24) | (in[9] << 16) | (in[10] << 8) | in[11];
+	const int channels = in[12];
+
+	const size_t n_pixels = size_t(*ncols) * *nrows;
+
+	*out = reinterpret_cast<uint8_t *>(malloc(n_pixels * 3));
+	if (!*out)
+		error_exit(true, "read_qoi: cannot allocate %zu bytes", n_pixels * 3);
+
+	uint8_t index[64][4] { };
+	uint8_t px[4] { 0, 0, 0, 255 };
+	size_t  p   = 14;
+	int     run = 0;
+
+	for(size_t i=0; i<n_pixels; i++) {
+		if (run)
+			run--;
+		else {
+			// ops are at most 5 bytes: never beyond the 8 byte end marker
+			if (p >= in_len - 8) {
+				free(*out);
+				return false;
+			}
+
+			const uint8_t b1 = in[p++];
+
+			if (b1 == 0xfe) {  // QOI_OP_RGB
+				px[0] = in[p++];
+				px[1] = in[p++];
+				px[2] = in[p++];
+			}
+			else if (b1 == 0xff) {  // QOI_OP_RGBA
+				memcpy(px, &in[p], 4);
+				p += 4;
+			}
+			else if ((b1 & 0xc0) == 0x00) {  // QOI_OP_INDEX
+				memcpy(px, index[b1], 4);
+			}
+			else if ((b1 & 0xc0) == 0x40) {  // QOI_OP_DIFF
+				px[0] += ((b1 >> 4) & 3) - 2;
+				px[1] += ((b1 >> 2) & 3) - 2;
+				px[2] += ( b1       & 3) - 2;
+			}
+			else if ((b1 & 0xc0) == 0x80) {  // QOI_OP_LUMA
+				const uint8_t b2 = in[p++];
+				const int     dg = (b1 & 0x3f) - 32;
+				px[0] += dg - 8 + ((b2 >> 4) & 0x0f);
+				px[1] += dg;
+				px[2] += dg - 8 + ( b2       & 0x0f);
+			}
+			else {  // QOI_OP_RUN
+				run = b1 & 0x3f;
+			}
+
+			memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+		}
+
+		memcpy(&(*out)[i * 3], px, 3);
+	}
+
+	return channels == 3 || channels == 4;
+}
+
+std::vector<uint8_t> png_compress_rgb(const int ncols, const int nrows, const int compression_level, const uint8_t *const in)
+{
+	std::vector<uint8_t> filtered;
+	filtered.reserve((ncols * 3 + 1) * nrows);
+	png_filter_rows(in, ncols * 3, 3, 0, nrows, compression_level > 0, &filtered);
+
+	uLongf               len = compressBound(filtered.size());
+	std::vector<uint8_t> out(len);
+
+	if (compress2(out.data(), &len, filtered.data(), filtered.size(), compression_level * 9 / 100) != Z_OK)
+		error_exit(false, "png_compress_rgb: compress2 failed");
+
+	out.resize(len);
+
+	return out;
 }
 
 void write_simple(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
 {
 	*out_len = ncols * nrows * 3 + 4;
-	*out = new uint8_t[*out_len];
+	*out = reinterpret_cast<uint8_t *>(malloc(*out_len));
+	if (!*out)
+		error_exit(true, "write_simple: cannot allocate %zu bytes", *out_len);
 
 	size_t offset = 0;
 	(*out)[offset++] = ncols >> 8;  // width
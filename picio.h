@@ -1,7 +1,19 @@
 #include <stdint.h>
+#include <vector>
 
 
+// 'in' is in the pixel format the writer needs: RGB for PNG, YUV420 for
+// JPEG, RGB for QOI and BGR for BMP/TGA (see pixfmt.h)
 void write_png(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
 void write_jpg(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
 void write_bmp(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
+void write_qoi(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
 void write_tga(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
+void write_simple(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len);
+
+// 'out' is malloc()ed RGB; false for data that is not (complete) QOI
+bool read_qoi(const uint8_t *const in, const size_t in_len, int *const ncols, int *const nrows, uint8_t **const out);
+
+// the zlib stream (IDAT/fdAT contents) of an RGB image, filtered like
+// write_png does
+std::vector<uint8_t> png_compress_rgb(const int ncols, const int nrows, const int compression_level, const uint8_t *const in);
@@ -0,0 +1,84 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+#include <cstring>
+
+#include "pixfmt.h"
+
+
+size_t get_pixel_format_size(const pixel_format_t pf, const int w, const int h)
+{
+	if (pf == PF_BGRX)
+		return size_t(w) * h * 4;
+
+	if (pf == PF_YUV420)
+		return size_t(w) * h + 2 * size_t((w + 1) / 2) * ((h + 1) / 2);
+
+	return size_t(w) * h * 3;
+}
+
+static void rgb_to_yuv420(const uint8_t *const rgb, const int w, const int h, uint8_t *const out)
+{
+	const int cw       = (w + 1) / 2;
+	const int ch       = (h + 1) / 2;
+	uint8_t  *y_plane  = out;
+	uint8_t  *u_plane  = out + size_t(w) * h;
+	uint8_t  *v_plane  = u_plane + size_t(cw) * ch;
+
+	// 16.16 fixed point
+	for(int y=0; y<h; y++) {
+		const uint8_t *in  = &rgb[y * w * 3];
+		uint8_t       *o   = &y_plane[y * w];
+
+		for(int x=0; x<w; x++, in += 3)
+			o[x] = (19595 * in[0] + 38470 * in[1] + 7471 * in[2] + 32768) >> 16;
+	}
+
+	// chroma from the average of each 2x2 block
+	for(int cy=0; cy<ch; cy++) {
+		const int y0 = cy * 2;
+		const int y1 = std::min(y0 + 1, h - 1);
+
+		for(int cx=0; cx<cw; cx++) {
+			const int x0 = cx * 2;
+			const int x1 = std::min(x0 + 1, w - 1);
+
+			const uint8_t *p00 = &rgb[(y0 * w + x0) * 3];
+			const uint8_t *p01 = &rgb[(y0 * w + x1) * 3];
+			const uint8_t *p10 = &rgb[(y1 * w + x0) * 3];
+			const uint8_t *p11 = &rgb[(y1 * w + x1) * 3];
+
+			const int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+			const int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+			const int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+
+			u_plane[cy * cw + cx] = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32767) >> 16;
+			v_plane[cy * cw + cx] = ( 32768 * r - 27439 * g -  5329 * b + (128 << 16) + 32767) >> 16;
+		}
+	}
+}
+
+void convert_rgb_pixels(const uint8_t *const rgb, const int w, const int h, const pixel_format_t pf, uint8_t *const out)
+{
+	const size_t n_pixels = size_t(w) * h;
+
+	if (pf == PF_RGB)
+		memcpy(out, rgb, n_pixels * 3);
+	else if (pf == PF_BGR) {
+		for(size_t i=0; i<n_pixels; i++) {
+			out[i * 3 + 0] = rgb[i * 3 + 2];
+			out[i * 3 + 1] = rgb[i * 3 + 1];
+			out[i * 3 + 2] = rgb[i * 3 + 0];
+		}
+	}
+	else if (pf == PF_BGRX) {
+		for(size_t i=0; i<n_pixels; i++) {
+			out[i * 4 + 0] = rgb[i * 3 + 2];
+			out[i * 4 + 1] = rgb[i * 3 + 1];
+			out[i * 4 + 2] = rgb[i * 3 + 0];
+			out[i * 4 + 3] = 0;
+		}
+	}
+	else if (pf == PF_YUV420) {
+		rgb_to_yuv420(rgb, w, h, out);
+	}
+}
@@ -0,0 +1,18 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+
+// RGB:    3 bytes per pixel, what terminal::render produces
+// BGR:    3 bytes per pixel (BMP, TGA)
+// BGRX:   4 bytes per pixel, 4th byte is 0 (VNC)
+// YUV420: planar, full range BT.601 (JFIF), Y plane of w x h followed by
+//         U and V planes of (w + 1) / 2 x (h + 1) / 2
+typedef enum { PF_RGB, PF_BGR, PF_BGRX, PF_YUV420 } pixel_format_t;
+
+size_t get_pixel_format_size(const pixel_format_t pf, const int w, const int h);
+
+// 'out' must be get_pixel_format_size() bytes in size
+void   convert_rgb_pixels   (const uint8_t *const rgb, const int w, const int h, const pixel_format_t pf, uint8_t *const out);
@@ -0,0 +1,54 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include "stats.h"
+
+
+stats_t stats;
+
+stats_t::stats_t()
+{
+}
+
+stats_t::~stats_t()
+{
+}
+
+void stats_t::add(const std::string & name, const uint64_t n)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	counters[name] += n;
+}
+
+void stats_t::set(const std::string & name, const uint64_t v)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	counters[name] = v;
+}
+
+uint64_t stats_t::get(const std::string & name)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = counters.find(name);
+	if (it == counters.end())
+		return 0;
+
+	return it->second;
+}
+
+std::string stats_t::get_json()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	std::string out;
+
+	for(auto & counter: counters) {
+		if (out.empty() == false)
+			out += ", ";
+
+		out += "\"" + counter.first + "\": " + std::to_string(counter.second);
+	}
+
+	return "{ " + out + " }";
+}
@@ -0,0 +1,27 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+
+// counters shown via /stats.json
+class stats_t
+{
+private:
+	std::mutex                      lock;
+	std::map<std::string, uint64_t> counters;
+
+public:
+	stats_t();
+	virtual ~stats_t();
+
+	void        add     (const std::string & name, const uint64_t n = 1);
+	void        set     (const std::string & name, const uint64_t v);
+	uint64_t    get     (const std::string & name);
+	std::string get_json();
+};
+
+extern stats_t stats;
@@ -64,3 +64,12 @@ std::string str_tolower(std::string s)
 
 	return s;
 }
+
+std::string trim(const std::string & in)
+{
+	const size_t start = in.find_first_not_of(" \t");
+	if (start == std::string::npos)
+		return "";
+
+	return in.substr(start, in.find_last_not_of(" \t") - start + 1);
+}
@@ -7,3 +7,5 @@ std::vector<std::string> split(const std::string & in_in, const std::string & sp
 std::string myformat(const char *const fmt, ...);
 
 std::string str_tolower(std::string s);
+
+std::string trim(const std::string & in);
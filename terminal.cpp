@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "logging.h"
+#include "stats.h"
 #include "str.h"
 #include "terminal.h"
 #include "time.h"
@@ -22,6 +23,9 @@ terminal::terminal(font *const f, const int w, const int h, std::atomic_bool *co
 	for(int i=0; i<w * h; i++)
 		screen[i].c = ' ';
 
+	row_hashes.resize(h);
+	dirty_rows.resize(h, true);
+
 	reset_h_tab_stops();
 
 	reset_v_tab_stops();
@@ -307,6 +311,10 @@ terminal::terminal(font *const f, const int w, const int h, std::atomic_bool *co
 terminal::~terminal()
 {
 	delete [] screen;
+
+	free(base_pixels);
+
+	clear_row_cache();
 }
 
 void terminal::resize_width(const int new_w)
@@ -321,6 +329,8 @@ void terminal::resize_width(const int new_w)
 
 	for(int i=0; i<w * h; i++)
 		screen[i].c = ' ';
+
+	mark_dirty(0, h - 1);
 }
 
 void terminal::reset_h_tab_stops()
@@ -354,6 +364,7 @@ void terminal::delete_line(const int y)
 		erase_line(y);
 	else {
 		memmove(&screen[offset_to], &screen[offset_from], n_characters_to_move * sizeof(screen[0]));
+		move_rows(y, y + 1, h - y - 1);
 
 		erase_line(h - 1);
 	}
@@ -367,8 +378,10 @@ void terminal::insert_line(const int y)
 
 	int n_characters_to_move = w * h - offset_to;
 
-	if (n_characters_to_move > 0)
+	if (n_characters_to_move > 0) {
 		memmove(&screen[offset_to], &screen[offset_from], n_characters_to_move * sizeof(screen[0]));
+		move_rows(y + 1, y, h - y - 1);
+	}
 
 	erase_line(y);
 }
@@ -447,6 +460,8 @@ void terminal::emit_character(const uint32_t c)
 	screen[y * w + x].bg_rgb      = bg_rgb;
 	screen[y * w + x].attr        = attr;
 
+	dirty_rows[y] = true;
+
 	x++;
 
 	last_character = c;
@@ -460,6 +475,7 @@ void terminal::scroll_up()
 	int n_characters_to_move = w * (scroll_region.second - scroll_region.first);
 	if (n_characters_to_move > 0 && offset_from + n_characters_to_move <= w * h) {
 		memmove(&screen[offset_to], &screen[offset_from], n_characters_to_move * sizeof(screen[0]));
+		move_rows(scroll_region.first, scroll_region.first + 1, scroll_region.second - scroll_region.first);
 		erase_line(scroll_region.second);
 	}
 }
@@ -636,6 +652,9 @@ std::optional<std::string> terminal::process_escape_CSI(const char cmd, const st
 			screen[pos].bg_rgb      = bg_rgb;
 			screen[pos].attr        = attr;
 		}
+
+		if (end_pos > start_pos)
+			mark_dirty(start_pos / w, (end_pos - 1) / w);
 	}
 	else if (cmd == 'K') {
 		int val = par1.has_value() ? par1.value() : 0;
@@ -677,9 +696,11 @@ std::optional<std::string> terminal::process_escape_CSI(const char cmd, const st
 		else if (parameters == "?3")  // DECCOLM
 			resize_width(132), x = 0, y = 0;
 		else if (parameters == "?5")  // DECSNM
-			global_invert = true;
+			global_invert = true, mark_dirty(0, h - 1);
 		else if (parameters == "?25")  // DECSET
 			show_cursor = true;
+		else if (parameters == "?2026")  // synchronized output
+			synchronized_since = get_ms();
 		else
 			dolog(ll_info, "%s %c not supported", parameters.c_str(), cmd);
 	}
@@ -691,12 +712,17 @@ std::optional<std::string> terminal::process_escape_CSI(const char cmd, const st
 		else if (parameters == "?3")  // DECCOLM
 			resize_width(80), x = 0, y = 0;
 		else if (parameters == "?5")  // DECSNM
-			global_invert = false;
+			global_invert = false, mark_dirty(0, h - 1);
 		else if (parameters == "?25")  // DECRSET
 			show_cursor = false;
+		else if (parameters == "?2026")  // synchronized output
+			synchronized_since = 0;
 		else
 			dolog(ll_info, "%s %c not supported", parameters.c_str(), cmd);
 	}
+	else if (cmd == 'p' && parameters == "?2026$") {  // DECRQM for synchronized output
+		send_back = myformat("\033[?2026;%d$y", synchronized_since ? 1 : 2);
+	}
 	else if (cmd == 'S') {
 		int n = std::min(h, pars.size() == 1 ? std::stoi(pars[0]) : 1);
 		DLD("CSI S (%d)", n);
@@ -868,6 +894,9 @@ std::optional<std::string> terminal::process_escape_CSI(const char cmd, const st
 		if (n == 0)
 			n = 1;
 
+		if (offset < max_offset)
+			mark_dirty(y, (std::min(offset + n, max_offset) - 1) / w);
+
 		for(int i=0; i<n && offset < max_offset; i++) {
 			screen[offset].c           = ' ';
 			screen[offset].fg_col_ansi = fg_col_ansi;
@@ -1153,15 +1182,50 @@ std::optional<std::string> terminal::process_input(const char *const in, const s
 		dolog(ll_warning, "Unexpected exception");
 	}
 
-	std::unique_lock<std::mutex> lck(lock);
-	latest_update = get_ms();
-	cond.notify_all();
+	// hold back frames while the program draws a synchronized update
+	if (synchronized_since && get_ms() - synchronized_since < SYNCHRONIZED_OUTPUT_TIMEOUT) {
+		stats.add("synchronized-updates-held");
 
-	do_render = true;
+		return send_back;
+	}
+
+	synchronized_since = 0;
+
+	publish_update();
 
 	return send_back;
 }
 
+// only wake up the renderer when something visible changed; called by
+// the input thread only (it owns dirty_rows and row_hashes)
+void terminal::publish_update()
+{
+	const uint64_t new_cells_hash = hash_screen();
+
+	std::optional<std::pair<int, int> > new_cursor;
+	if (show_cursor && x < w && y < h)
+		new_cursor = { x, y };
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	const bool cells_changed = new_cells_hash != cells_hash;
+
+	if (cells_changed || new_cursor != notified_cursor) {
+		cells_hash      = new_cells_hash;
+		notified_cursor = new_cursor;
+
+		latest_update = get_ms();
+		cond.notify_all();
+
+		// a cursor movement is only an overlay change
+		if (cells_changed)
+			do_render = true;
+	}
+	else {
+		stats.add("terminal-updates-suppressed");
+	}
+}
+
 std::optional<std::string> terminal::process_input(const std::string & in)
 {
 	return process_input(in.c_str(), in.size());
@@ -1196,17 +1260,190 @@ bool terminal::wait_for_frame(uint64_t *const ts_after, const int max_wait)
 	return rc;
 }
 
-void terminal::render(uint8_t **const out, int *const out_w, int *const out_h)
+bool terminal::draw_cell(const pos_t & cell, const bool invert_screen, const int cx, const int cy, const bool blink_on, uint8_t *const out, const int out_w, const int out_h)
 {
-	do_render = false;
+	const int char_w   = f->get_width ();
+	const int char_h   = f->get_height();
 
-	uint64_t start_wait = get_ms();
+	uint32_t c            = cell.c;
+
+	bool     bold         = cell.attr & A_BOLD;
+	bool     dim          = cell.attr & A_DIM;
+
+	font::intensity_t intensity = font::intensity_t::I_NORMAL;
+
+	if (bold)
+		intensity = font::intensity_t::I_BOLD;
+	else if (dim)
+		intensity = font::intensity_t::I_DIM;
+
+	int      fg_color     = cell.fg_col_ansi;
+	int      bg_color     = cell.bg_col_ansi;
+
+	if (fg_color == bg_color && fg_color != -1)
+		fg_color = 7, bg_color = 0;
+
+	rgb_t    fg;
+	if (fg_color == -1)
+		fg   = cell.fg_rgb.value();
+	else
+		fg   = color_map[bold][fg_color];
+
+	rgb_t    bg;
+	if (bg_color == -1)
+		bg   = cell.bg_rgb.value();
+	else
+		bg   = color_map[0][bg_color];
+
+	bool     inverse      = !!(cell.attr & A_INVERSE);
+	bool     blink        = !!(cell.attr & A_BLINK);
+	bool     strikethrough= !!(cell.attr & A_STRIKETHROUGH);
+	bool     underline    = !!(cell.attr & A_UNDERLINE);
+	bool     italic       = !!(cell.attr & A_ITALIC);
+
+	if (blink)
+		inverse = blink_on;
+
+	int     x            = cx * char_w;
+	int     y            = cy * char_h;
 
-	if (start_wait - blink_switch_ts >= 60000 / 150) {
-		blink_state     = !blink_state;
-		blink_switch_ts = latest_update;
+	if (invert_screen)
+		std::swap(fg, bg);
+
+	if (!f->draw_glyph(c, intensity, inverse, underline, strikethrough, italic, fg, bg, x, y, out, out_w, out_h)) {
+		for(int cy=y; cy<y + char_h; cy++) {
+			for(int cx=x; cx<x + char_w; cx++) {
+				out[cy * out_w * 3 + cx * 3 + 0] = rand();
+				out[cy * out_w * 3 + cx * 3 + 1] = rand();
+				out[cy * out_w * 3 + cx * 3 + 2] = rand();
+			}
+		}
 	}
 
+	return blink;
+}
+
+static bool cells_equal(const pos_t & a, const pos_t & b)
+{
+	if (a.c != b.c || a.attr != b.attr || a.fg_col_ansi != b.fg_col_ansi || a.bg_col_ansi != b.bg_col_ansi)
+		return false;
+
+	// the rgb values are only used when the ansi color is -1
+	if (a.fg_col_ansi == -1 && (a.fg_rgb.value().r != b.fg_rgb.value().r || a.fg_rgb.value().g != b.fg_rgb.value().g || a.fg_rgb.value().b != b.fg_rgb.value().b))
+		return false;
+
+	if (a.bg_col_ansi == -1 && (a.bg_rgb.value().r != b.bg_rgb.value().r || a.bg_rgb.value().g != b.bg_rgb.value().g || a.bg_rgb.value().b != b.bg_rgb.value().b))
+		return false;
+
+	return true;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint64_t v)
+{
+	for(int i=0; i<8; i++) {
+		hash ^= (v >> (i * 8)) & 255;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// FNV-1a over everything that determines how a row ('w' cells) looks
+uint64_t terminal::hash_row(const pos_t *const cells, const bool invert_screen) const
+{
+	uint64_t hash = fnv1a(14695981039346656037ull, invert_screen);
+
+	for(int cx=0; cx<w; cx++) {
+		const pos_t & cell = cells[cx];
+
+		hash = fnv1a(hash, (uint64_t(cell.c) << 32) | uint32_t(cell.attr));
+		hash = fnv1a(hash, (uint64_t(uint32_t(cell.fg_col_ansi)) << 32) | uint32_t(cell.bg_col_ansi));
+
+		if (cell.fg_col_ansi == -1)
+			hash = fnv1a(hash, (cell.fg_rgb.value().r << 16) | (cell.fg_rgb.value().g << 8) | cell.fg_rgb.value().b);
+
+		if (cell.bg_col_ansi == -1)
+			hash = fnv1a(hash, (cell.bg_rgb.value().r << 16) | (cell.bg_rgb.value().g << 8) | cell.bg_rgb.value().b);
+	}
+
+	return hash;
+}
+
+// only the rows that changed since the previous call are hashed again
+uint64_t terminal::hash_screen()
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for(int cy=0; cy<h; cy++) {
+		if (dirty_rows[cy]) {
+			row_hashes[cy] = hash_row(&screen[cy * w], global_invert);
+			dirty_rows[cy] = false;
+		}
+
+		hash = fnv1a(hash, row_hashes[cy]);
+	}
+
+	return hash;
+}
+
+void terminal::mark_dirty(const int cy_first, const int cy_last)
+{
+	for(int cy=std::max(0, cy_first); cy<=std::min(h - 1, cy_last); cy++)
+		dirty_rows[cy] = true;
+}
+
+// follows a memmove of 'n' rows of the screen, so that scrolling does not
+// need to rehash the rows that only moved
+void terminal::move_rows(const int cy_to, const int cy_from, const int n)
+{
+	if (n <= 0)
+		return;
+
+	if (cy_to < cy_from) {
+		std::copy(row_hashes.begin() + cy_from, row_hashes.begin() + cy_from + n, row_hashes.begin() + cy_to);
+		std::copy(dirty_rows.begin() + cy_from, dirty_rows.begin() + cy_from + n, dirty_rows.begin() + cy_to);
+	}
+	else {
+		std::copy_backward(row_hashes.begin() + cy_from, row_hashes.begin() + cy_from + n, row_hashes.begin() + cy_to + n);
+		std::copy_backward(dirty_rows.begin() + cy_from, dirty_rows.begin() + cy_from + n, dirty_rows.begin() + cy_to + n);
+	}
+}
+
+std::list<row_strip_t>::iterator terminal::find_row_strip(const uint64_t hash, const std::vector<pos_t> & cells, const bool invert_screen)
+{
+	auto range = row_cache_index.equal_range(hash);
+
+	for(auto it = range.first; it != range.second; it++) {
+		auto & strip = *it->second;
+
+		if (strip.global_invert != invert_screen || strip.cells.size() != cells.size())
+			continue;
+
+		bool equal = true;
+		for(size_t cx=0; cx<cells.size() && equal; cx++)
+			equal = cells_equal(strip.cells[cx], cells[cx]);
+
+		if (equal)
+			return it->second;
+	}
+
+	return row_cache.end();
+}
+
+void terminal::clear_row_cache()
+{
+	for(auto & strip: row_cache)
+		free(strip.pixels);
+
+	row_cache.clear();
+	row_cache_index.clear();
+}
+
+// renders all cells with blinking ones in their "off" state, without cursor
+void terminal::render(uint8_t **const out, int *const out_w, int *const out_h)
+{
+	do_render = false;
+
 	const int char_w   = f->get_width ();
 	const int char_h   = f->get_height();
 
@@ -1219,78 +1456,182 @@ void terminal::render(uint8_t **const out, int *const out_w, int *const out_h)
 	size_t n_bytes = w * char_w * h * char_h * 3;
 	*out = reinterpret_cast<uint8_t *>(calloc(1, n_bytes));
 
-	for(int cy=0; cy<h; cy++) {
-		for(int cx=0; cx<w; cx++) {
-			int      offset       = cy * w + cx;
-			uint32_t c            = screen[offset].c;
+	const size_t row_bytes = n_bytes / h;
 
-			bool     bold         = screen[offset].attr & A_BOLD;
-			bool     dim          = screen[offset].attr & A_DIM;
+	blink_cells.clear();
 
-			font::intensity_t intensity = font::intensity_t::I_NORMAL;
+	base_hash = 14695981039346656037ull;
 
-			if (bold)
-				intensity = font::intensity_t::I_BOLD;
-			else if (dim)
-				intensity = font::intensity_t::I_DIM;
+	// the input thread keeps changing the screen: each row is copied once
+	// so that the hash, the pixels and the cells of a cached strip match
+	const bool invert_screen = global_invert;
 
-			int      fg_color     = screen[offset].fg_col_ansi;
-			int      bg_color     = screen[offset].bg_col_ansi;
+	// rows that were drawn before (also at an other position) are copied
+	for(int cy=0; cy<h; cy++) {
+		uint8_t *const     row_out = *out + cy * row_bytes;
+		std::vector<pos_t> cells(&screen[cy * w], &screen[(cy + 1) * w]);
+		const uint64_t     hash    = hash_row(cells.data(), invert_screen);
+		auto               strip   = find_row_strip(hash, cells, invert_screen);
 
-			if (fg_color == bg_color && fg_color != -1)
-				fg_color = 7, bg_color = 0;
+		base_hash = fnv1a(base_hash, hash);
 
-			rgb_t    fg;
-			if (fg_color == -1)
-				fg   = screen[offset].fg_rgb.value();
-			else
-				fg   = color_map[bold][fg_color];
+		if (strip != row_cache.end()) {
+			memcpy(row_out, strip->pixels, row_bytes);
 
-			rgb_t    bg;
-			if (bg_color == -1)
-				bg   = screen[offset].bg_rgb.value();
-			else
-				bg   = color_map[0][bg_color];
+			for(auto cx: strip->blink_columns)
+				blink_cells.push_back({ cx, cy });
 
-			bool     inverse      = !!(screen[offset].attr & A_INVERSE);
-			bool     blink        = !!(screen[offset].attr & A_BLINK);
-			bool     strikethrough= !!(screen[offset].attr & A_STRIKETHROUGH);
-			bool     underline    = !!(screen[offset].attr & A_UNDERLINE);
-			bool     italic       = !!(screen[offset].attr & A_ITALIC);
+			row_cache.splice(row_cache.begin(), row_cache, strip);
 
-			if (blink)
-				inverse = blink_state;
+			continue;
+		}
 
-			int     x            = cx * char_w;
-			int     y            = cy * char_h;
+		row_strip_t new_strip { };
+		new_strip.hash          = hash;
+		new_strip.global_invert = invert_screen;
 
-			if (global_invert)
-				std::swap(fg, bg);
+		for(int cx=0; cx<w; cx++) {
+			if (draw_cell(cells[cx], invert_screen, cx, cy, false, *out, *out_w, *out_h)) {
+				blink_cells.push_back({ cx, cy });
+				new_strip.blink_columns.push_back(cx);
+			}
+		}
 
-			if (!f->draw_glyph(c, intensity, inverse, underline, strikethrough, italic, fg, bg, x, y, *out, *out_w, *out_h)) {
-				for(int cy=y; cy<y + char_h; cy++) {
-					for(int cx=x; cx<x + char_w; cx++) {
-						(*out)[cy * *out_w * 3 + cx * 3 + 0] = rand();
-						(*out)[cy * *out_w * 3 + cx * 3 + 1] = rand();
-						(*out)[cy * *out_w * 3 + cx * 3 + 2] = rand();
-					}
+		new_strip.cells  = std::move(cells);
+		new_strip.pixels = reinterpret_cast<uint8_t *>(malloc(row_bytes));
+		memcpy(new_strip.pixels, row_out, row_bytes);
+
+		row_cache.push_front(new_strip);
+		row_cache_index.insert({ hash, row_cache.begin() });
+
+		// keep a few screens worth of rows
+		while(int(row_cache.size()) > h * 4) {
+			auto last  = std::prev(row_cache.end());
+			auto range = row_cache_index.equal_range(last->hash);
+
+			for(auto it = range.first; it != range.second; it++) {
+				if (it->second == last) {
+					row_cache_index.erase(it);
+					break;
 				}
 			}
+
+			free(last->pixels);
+			row_cache.erase(last);
 		}
 	}
+}
 
-	// cursor
-	if (show_cursor) {
-		int basic_offset = y * *out_w * char_h * 3 + x * char_w * 3;
-		for(int cy=0; cy<char_h; cy++) {
-			for(int cx=0; cx<char_w; cx++) {
-				int offset = basic_offset + cy * *out_w * 3 + cx * 3;
-				(*out)[offset + 0] ^= 255;
-				(*out)[offset + 1] ^= 255;
-				(*out)[offset + 2] ^= 255;
+rect_t terminal::get_cell_rect(const int cx, const int cy) const
+{
+	const int char_w = f->get_width ();
+	const int char_h = f->get_height();
+
+	return { cx * char_w, cy * char_h, char_w, char_h };
+}
+
+std::shared_ptr<frame> terminal::get_frame()
+{
+	std::unique_lock<std::mutex> lck(frame_lock);
+
+	const uint64_t sync_start = synchronized_since;
+
+	if (sync_start) {
+		// a synchronized update that did not end in time is shown anyway
+		if (get_ms() - sync_start >= SYNCHRONIZED_OUTPUT_TIMEOUT) {
+			dolog(ll_debug, "synchronized update timed out");
+
+			synchronized_since = 0;
+
+			// no publish_update() here: hashing the screen is for the input
+			// thread; the screen is rendered below
+			std::unique_lock<std::mutex> lck_update(lock);
+
+			do_render     = true;
+			latest_update = get_ms();
+			cond.notify_all();
+		}
+		// else show nothing of the half drawn screen, also not the cursor or blinking
+		else if (latest_frame != nullptr) {
+			stats.add("synchronized-frames-held");
+
+			return latest_frame;
+		}
+	}
+
+	const bool full = do_render || base_pixels == nullptr;
+
+	if (full) {
+		free(base_pixels);
+		render(&base_pixels, &base_w, &base_h);
+	}
+
+	// cursor and blinking cells are overlays on top of the base image
+	const bool new_blink_state = blink_cells.empty() == false && (get_ms() / (60000 / 150)) & 1;
+
+	std::optional<std::pair<int, int> > new_cursor;
+	if (show_cursor && x < w && y < h)
+		new_cursor = { x, y };
+
+	uint64_t content_hash = fnv1a(base_hash, new_blink_state);
+	if (new_cursor.has_value())
+		content_hash = fnv1a(content_hash, (uint64_t(new_cursor.value().first) << 32) | new_cursor.value().second);
+
+	// nothing visible changed: keep the frame (and what was encoded from it)
+	if (latest_frame != nullptr && latest_frame->get_content_hash() == content_hash) {
+		if (full)
+			stats.add("frames-suppressed");
+
+		return latest_frame;
+	}
+
+	std::vector<rect_t> damage;
+
+	if (full)
+		damage.push_back({ 0, 0, base_w, base_h });
+	else {
+		if (new_blink_state != overlay_blink_state) {
+			for(auto & cell: blink_cells)
+				damage.push_back(get_cell_rect(cell.first, cell.second));
+		}
+
+		if (new_cursor != overlay_cursor) {
+			if (overlay_cursor.has_value())
+				damage.push_back(get_cell_rect(overlay_cursor.value().first, overlay_cursor.value().second));
+
+			if (new_cursor.has_value())
+				damage.push_back(get_cell_rect(new_cursor.value().first, new_cursor.value().second));
+		}
+	}
+
+	const size_t n_bytes = base_w * base_h * 3;
+	uint8_t     *pixels  = reinterpret_cast<uint8_t *>(malloc(n_bytes));
+	memcpy(pixels, base_pixels, n_bytes);
+
+	if (new_blink_state) {
+		for(auto & cell: blink_cells)
+			draw_cell(screen[cell.second * w + cell.first], global_invert, cell.first, cell.second, true, pixels, base_w, base_h);
+	}
+
+	if (new_cursor.has_value()) {
+		const rect_t r = get_cell_rect(new_cursor.value().first, new_cursor.value().second);
+
+		for(int cy=r.y; cy<r.y + r.h; cy++) {
+			for(int cx=r.x; cx<r.x + r.w; cx++) {
+				int offset = cy * base_w * 3 + cx * 3;
+				pixels[offset + 0] ^= 255;
+				pixels[offset + 1] ^= 255;
+				pixels[offset + 2] ^= 255;
 			}
 		}
 	}
+
+	overlay_blink_state = new_blink_state;
+	overlay_cursor      = new_cursor;
+
+	latest_frame = std::make_shared<frame>(pixels, base_w, base_h, ++frame_nr, content_hash, damage);
+
+	return latest_frame;
 }
 
 char terminal::get_char_at(const int cx, const int cy) const
@@ -1313,8 +1654,12 @@ void terminal::erase_cell(const int cx, const int cy)
 
 	screen[offset].c           = ' ';
 	screen[offset].fg_col_ansi = fg_col_ansi;
+	screen[offset].fg_rgb      = fg_rgb;
 	screen[offset].bg_col_ansi = bg_col_ansi;
+	screen[offset].bg_rgb      = bg_rgb;
 	screen[offset].attr        = attr;
+
+	dirty_rows[cy] = true;
 }
 
 void terminal::erase_line(const int cy)
@@ -1331,3 +1676,9 @@ void terminal::get_dimensions(int *const out_w, int *const out_h)
 	*out_w = w * char_w;
 	*out_h = h * char_h;
 }
+
+void terminal::get_cell_dimensions(int *const out_w, int *const out_h) const
+{
+	*out_w = f->get_width ();
+	*out_h = f->get_height();
+}
@@ -2,13 +2,18 @@
 #include <atomic>
 #include <condition_variable>
 #include <cstddef>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common.h"
 #include "font.h"
+#include "frame.h"
 
 
 #define A_BOLD          (1 << 0)
@@ -19,6 +24,9 @@
 #define A_BLINK         (1 << 5)
 #define A_ITALIC        (1 << 6)
 
+// maximum duration (ms) of a synchronized update (CSI ? 2026 h ... l)
+#define SYNCHRONIZED_OUTPUT_TIMEOUT 500
+
 typedef enum { ET_NONE, ET_DCS, ET_CSI, ET_ST, ET_OSC } escape_type_t;
 
 #define DLD(...)  do {                                    \
@@ -38,6 +46,15 @@ typedef struct {
 	int                  attr;
 } pos_t;
 
+// a rasterized terminal row, reused when a row with the same cells is drawn again
+typedef struct {
+	uint64_t           hash;
+	std::vector<pos_t> cells;
+	bool               global_invert;
+	uint8_t           *pixels;
+	std::vector<int>   blink_columns;
+} row_strip_t;
+
 class terminal {
 private:
 	font       *const f { nullptr };
@@ -64,8 +81,6 @@ private:
 	int               utf8_len    { 0 };
 	uint32_t          utf8_code   { 0 };
 	bool              OSC         { false };
-	bool              blink_state { false };
-	uint64_t          blink_switch_ts { 0 };
 	bool              wraparound  { true  };
 	std::vector<bool> h_tab_stops;
 	std::vector<bool> v_tab_stops;
@@ -78,6 +93,37 @@ private:
 
 	mutable std::mutex              lock;
 	mutable std::condition_variable cond;
+
+	std::mutex                      frame_lock;
+	std::shared_ptr<frame>          latest_frame;
+	uint64_t                        frame_nr { 0 };
+	uint8_t                        *base_pixels { nullptr };  // without cursor and blink
+	uint64_t                        base_hash   { 0 };
+	uint64_t                        cells_hash  { 0 };  // screen contents at the latest notification
+	// only used by the thread that calls process_input() (bytes, not the
+	// packed std::vector<bool>, so setting one never rewrites others)
+	std::vector<uint64_t>           row_hashes;  // hash_row() of each row, valid when not dirty
+	std::vector<uint8_t>            dirty_rows;
+	std::optional<std::pair<int, int> > notified_cursor;
+	std::atomic_uint64_t            synchronized_since { 0 };  // 0: not in a synchronized update
+	int                             base_w { 0 };
+	int                             base_h { 0 };
+	std::vector<std::pair<int, int> > blink_cells;
+	bool                            overlay_blink_state { false };
+	std::optional<std::pair<int, int> > overlay_cursor;
+
+	std::list<row_strip_t>          row_cache;  // most recently used at the front
+	std::unordered_multimap<uint64_t, std::list<row_strip_t>::iterator> row_cache_index;
+
+	bool   draw_cell    (const pos_t & cell, const bool invert_screen, const int cx, const int cy, const bool blink_on, uint8_t *const out, const int out_w, const int out_h);
+	uint64_t hash_row   (const pos_t *const cells, const bool invert_screen) const;
+	uint64_t hash_screen();
+	void   mark_dirty   (const int cy_first, const int cy_last);
+	void   move_rows    (const int cy_to, const int cy_from, const int n);
+	void   publish_update();
+	std::list<row_strip_t>::iterator find_row_strip(const uint64_t hash, const std::vector<pos_t> & cells, const bool invert_screen);
+	void   clear_row_cache();
+	rect_t get_cell_rect(const int cx, const int cy) const;
 	std::atomic_bool         *const stop_flag;
 
 public:
@@ -121,5 +167,9 @@ public:
 	bool wait_for_frame(uint64_t *const ts_after, const int max_wait);
 	bool has_new_frame() const { return do_render; }
 	void render(uint8_t **const out, int *const out_w, int *const out_h);
+	// renders only when something changed since the previous frame
+	std::shared_ptr<frame> get_frame();
 	void get_dimensions(int *const out_w, int *const out_h);
+	void get_cell_dimensions(int *const out_w, int *const out_h) const;
+	const rgb_t *get_256c_palette() const { return color_map_256c; }
 };
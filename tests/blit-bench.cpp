@@ -0,0 +1,218 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+// compares the blit kernels of font_freetype against the per-pixel loop
+// they replaced, for every pixel mode / invert / color / decoration
+// build: make blit-bench
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../blit-kernel.h"
+
+
+static uint64_t get_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the previous draw_glyph_bitmap_low, writing to a caller supplied buffer
+// (with the MONO x-offset corrected so that the outputs can be compared)
+static void reference_blit(const FT_Bitmap *const bitmap, const rgb_t & fg, const rgb_t & bg, const bool has_color, const int max, const bool invert, const bool underline, const bool strikethrough, uint8_t *const result, const int result_width, const int result_height)
+{
+	const int max1 = max - 1;
+
+	if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+		for(unsigned glyph_y=0; glyph_y<bitmap->rows; glyph_y++) {
+			for(unsigned glyph_x=0; glyph_x<bitmap->width / 8; glyph_x++) {
+				int     io = glyph_y * bitmap->width / 8 + glyph_x;
+				uint8_t b  = bitmap->buffer[io];
+
+				int screen_buffer_offset = glyph_y * result_width * 3 + glyph_x * 24;
+
+				for(int xbit=0; xbit < 8; xbit++) {
+					int pixel_v = b & 128 ? max1 : 0;
+					b <<= 1;
+
+					int sub = max1 - pixel_v;
+
+					if (invert)
+						pixel_v = sub;
+
+					if (screen_buffer_offset >= 0) {
+						result[screen_buffer_offset + 0] = (pixel_v * fg.r + sub * bg.r) >> 8;
+						result[screen_buffer_offset + 1] = (pixel_v * fg.g + sub * bg.g) >> 8;
+						result[screen_buffer_offset + 2] = (pixel_v * fg.b + sub * bg.b) >> 8;
+					}
+
+					screen_buffer_offset += 3;
+				}
+			}
+		}
+	}
+	else if (bitmap->pixel_mode == FT_PIXEL_MODE_GRAY) {
+		for(unsigned glyph_y=0; glyph_y<bitmap->rows; glyph_y++) {
+			int screen_buffer_offset = glyph_y * result_width * 3;
+			int io_base = glyph_y * bitmap->width;
+
+			for(unsigned glyph_x=0; glyph_x<bitmap->width; glyph_x++) {
+				int local_screen_buffer_offset = screen_buffer_offset + glyph_x * 3;
+
+				int pixel_v = (bitmap->buffer[io_base + glyph_x] * max) >> 8;
+
+				int sub = max1 - pixel_v;
+
+				if (invert)
+					pixel_v = sub;
+
+				result[local_screen_buffer_offset + 0] = (pixel_v * fg.r + sub * bg.r) >> 8;
+				result[local_screen_buffer_offset + 1] = (pixel_v * fg.g + sub * bg.g) >> 8;
+				result[local_screen_buffer_offset + 2] = (pixel_v * fg.b + sub * bg.b) >> 8;
+			}
+		}
+	}
+	else {
+		const bool lcd      = bitmap->pixel_mode == FT_PIXEL_MODE_LCD;
+		const int  bpp      = lcd ? 3 : 4;
+		const int  r_offset = lcd ? 0 : 2;
+
+		for(unsigned glyph_y=0; glyph_y<bitmap->rows; glyph_y++) {
+			int screen_buffer_offset = glyph_y * result_width * 3;
+			int io_base = glyph_y * bitmap->pitch;
+
+			for(int glyph_x=0; glyph_x<result_width; glyph_x++) {
+				int local_screen_buffer_offset = screen_buffer_offset + glyph_x * 3;
+
+				int io = io_base + glyph_x * bpp;
+
+				int pixel_vr = (bitmap->buffer[io + r_offset    ] * max) >> 8;
+				int pixel_vg = (bitmap->buffer[io + 1           ] * max) >> 8;
+				int pixel_vb = (bitmap->buffer[io + 2 - r_offset] * max) >> 8;
+
+				if (invert) {
+					pixel_vr = max1 - pixel_vr;
+					pixel_vg = max1 - pixel_vg;
+					pixel_vb = max1 - pixel_vb;
+				}
+
+				if (has_color) {
+					result[local_screen_buffer_offset + 0] = pixel_vr;
+					result[local_screen_buffer_offset + 1] = pixel_vg;
+					result[local_screen_buffer_offset + 2] = pixel_vb;
+				}
+				else {
+					int sub = (lcd ? max : max1) - pixel_vr;
+					result[local_screen_buffer_offset + 0] = (pixel_vr * fg.r + sub * bg.r) >> 8;
+					result[local_screen_buffer_offset + 1] = (pixel_vr * fg.g + sub * bg.g) >> 8;
+					result[local_screen_buffer_offset + 2] = (pixel_vr * fg.b + sub * bg.b) >> 8;
+				}
+			}
+		}
+	}
+
+	const uint8_t line[] { uint8_t((max * fg.r) >> 8), uint8_t((max * fg.g) >> 8), uint8_t((max * fg.b) >> 8) };
+
+	if (strikethrough) {
+		uint8_t *out = &result[result_height / 2 * result_width * 3];
+
+		for(int glyph_x=0; glyph_x<result_width; glyph_x++, out += 3) {
+			out[0] = line[0];
+			out[1] = line[1];
+			out[2] = line[2];
+		}
+	}
+
+	if (underline && result_height >= 2) {
+		uint8_t *out = &result[(result_height - 2) * result_width * 3];
+
+		for(int glyph_x=0; glyph_x<result_width; glyph_x++, out += 3) {
+			out[0] = line[0];
+			out[1] = line[1];
+			out[2] = line[2];
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	// a 16x32 glyph, about the size of a cell at the usual font sizes
+	constexpr int width      = 16;
+	constexpr int height     = 32;
+	const int     iterations = argc >= 2 ? atoi(argv[1]) : 100000;
+
+	const struct {
+		int         pixel_mode;
+		const char *name;
+		int         bytes_per_pixel;  // 0: 1 bit
+	} modes[] {
+		{ FT_PIXEL_MODE_MONO, "mono", 0 },
+		{ FT_PIXEL_MODE_GRAY, "gray", 1 },
+		{ FT_PIXEL_MODE_LCD,  "lcd",  3 },
+		{ FT_PIXEL_MODE_BGRA, "bgra", 4 },
+	};
+
+	const rgb_t fg { 200, 180, 160 };
+	const rgb_t bg {  10,  20,  30 };
+	const int   max = 201;  // I_NORMAL
+
+	std::vector<uint8_t> reference_out(width * height * 3);
+	std::vector<uint8_t> kernel_out   (width * height * 3);
+
+	printf("mode invert color decorated  old ns/pixel  new ns/pixel\n");
+
+	for(size_t mode_index=0; mode_index<4; mode_index++) {
+		auto & mode = modes[mode_index];
+
+		const int pitch = mode.bytes_per_pixel ? width * mode.bytes_per_pixel : width / 8;
+
+		std::vector<uint8_t> buffer(pitch * height);
+		for(auto & b: buffer)
+			b = rand();
+
+		FT_Bitmap bitmap { };
+		bitmap.rows       = height;
+		bitmap.width      = mode.pixel_mode == FT_PIXEL_MODE_LCD ? width * 3 : width;
+		bitmap.pitch      = pitch;
+		bitmap.buffer     = buffer.data();
+		bitmap.pixel_mode = mode.pixel_mode;
+
+		for(int variant=0; variant<8; variant++) {
+			const bool invert    = variant & 4;
+			const bool has_color = variant & 2;
+			const bool decorated = variant & 1;
+
+			blit_parameters_t p { };
+			p.fg                = fg;
+			p.bg                = bg;
+			p.max               = max;
+			p.max1              = max - 1;
+			p.underline_row     = decorated ? height - 2 : -1;
+			p.strikethrough_row = decorated ? height / 2 : -1;
+			p.line[0]           = (max * fg.r) >> 8;
+			p.line[1]           = (max * fg.g) >> 8;
+			p.line[2]           = (max * fg.b) >> 8;
+
+			const blit_kernel_t kernel = blit_kernels[mode_index][invert][has_color][decorated];
+
+			uint64_t start = get_ns();
+			for(int i=0; i<iterations; i++)
+				reference_blit(&bitmap, fg, bg, has_color, max, invert, decorated, decorated, reference_out.data(), width, height);
+			uint64_t reference_ns = get_ns() - start;
+
+			start = get_ns();
+			for(int i=0; i<iterations; i++)
+				kernel(&bitmap, p, kernel_out.data(), width);
+			uint64_t kernel_ns = get_ns() - start;
+
+			// inverted mono/gray glyphs were blended with the wrong weights before
+			const bool same = reference_out == kernel_out;
+
+			const double pixels = double(iterations) * width * height;
+
+			printf("%-4s %-6s %-5s %-9s  %12.3f  %12.3f%s\n", mode.name, invert ? "yes" : "no", has_color ? "yes" : "no", decorated ? "yes" : "no",
+					reference_ns / pixels, kernel_ns / pixels, same ? "" : "  (output differs)");
+		}
+	}
+
+	return 0;
+}
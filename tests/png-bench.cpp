@@ -0,0 +1,183 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+// compares write_png against the libpng based writer it replaced, on the
+// same frames and for several compression levels
+// build: make png-bench
+#include <chrono>
+#include <png.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "../error.h"
+#include "../picio.h"
+
+
+static uint64_t get_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void libpng_error_handler(png_structp png, png_const_charp msg)
+{
+	error_exit(false, "libpng error: %s", msg);
+}
+
+static void libpng_warning_handler(png_structp png, png_const_charp msg)
+{
+	printf("libpng warning: %s\n", msg);
+}
+
+// the previous write_png: libpng writing to an open_memstream
+static void reference_write_png(const int ncols, const int nrows, const int compression_level, const uint8_t *const in, uint8_t **const out, size_t *const out_len)
+{
+	FILE *fh = open_memstream(reinterpret_cast<char **>(out), out_len);
+
+	std::vector<png_bytep> row_pointers(nrows);
+	for(int y=0; y<nrows; y++)
+		row_pointers[y] = const_cast<uint8_t *>(&in[y * ncols * 3]);
+
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, libpng_error_handler, libpng_warning_handler);
+	if (!png)
+		error_exit(false, "png_create_write_struct failed");
+
+	png_infop info = png_create_info_struct(png);
+	if (info == nullptr)
+		error_exit(false, "png_create_info_struct failed");
+
+	png_init_io(png, fh);
+
+	png_set_compression_level(png, compression_level * 9 / 100);
+
+	png_set_IHDR(png, info, ncols, nrows, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	png_text text_ptr[2] { };
+	text_ptr[0].key         = png_charp("Author");
+	text_ptr[0].text        = png_charp("termcamng");
+	text_ptr[0].compression = PNG_TEXT_COMPRESSION_NONE;
+	text_ptr[1].key         = png_charp("URL");
+	text_ptr[1].text        = png_charp("https://github.com/folkertvanheusden/termcamng");
+	text_ptr[1].compression = PNG_TEXT_COMPRESSION_NONE;
+	png_set_text(png, info, text_ptr, 2);
+
+	png_write_info(png, info);
+
+	png_write_image(png, row_pointers.data());
+	png_write_end(png, nullptr);
+
+	png_destroy_write_struct(&png, &info);
+
+	fclose(fh);
+}
+
+// true when the PNG decodes to exactly 'rgb'
+static bool decodes_to(const uint8_t *const png_data, const size_t png_len, const std::vector<uint8_t> & rgb)
+{
+	png_image image { };
+	image.version = PNG_IMAGE_VERSION;
+
+	if (!png_image_begin_read_from_memory(&image, png_data, png_len))
+		return false;
+
+	image.format = PNG_FORMAT_RGB;
+
+	std::vector<uint8_t> decoded(PNG_IMAGE_SIZE(image));
+	if (!png_image_finish_read(&image, nullptr, decoded.data(), 0, nullptr))
+		return false;
+
+	return decoded == rgb;
+}
+
+// a terminal-like frame: 80x25 cells of 9x18 pixels with a small set of
+// repeating "glyphs"; 'colored' gives each line its own foreground color
+// and anti-aliases the glyph edges, so that it has more than 256 colors
+static std::vector<uint8_t> make_frame(const int width, const int height, const bool colored)
+{
+	constexpr int cell_w = 9;
+	constexpr int cell_h = 18;
+
+	std::vector<uint8_t> glyphs(64 * cell_w * cell_h);
+	srand(1);
+	for(auto & g: glyphs)
+		g = rand() % 3 == 0 ? 255 : 0;
+
+	std::vector<uint8_t> frame(width * height * 3);
+
+	for(int y=0; y<height; y++) {
+		const int cy = y / cell_h;
+
+		const uint8_t fg[] { uint8_t(colored ? 64 + cy * 37 % 192 : 200), uint8_t(colored ? 64 + cy * 91 % 192 : 200), uint8_t(colored ? 64 + cy * 53 % 192 : 200) };
+
+		for(int x=0; x<width; x++) {
+			const int cx    = x / cell_w;
+			// lines of varying length, as in a directory listing
+			const bool text = cx < 20 + cy * 7 % 60;
+			const int glyph = (cx * 7 + cy * 3) % 64;
+
+			int v = text ? glyphs[(glyph * cell_h + y % cell_h) * cell_w + x % cell_w] : 0;
+			if (colored && text && x % cell_w > 0)
+				v = (v * 3 + glyphs[(glyph * cell_h + y % cell_h) * cell_w + x % cell_w - 1]) / 4;
+
+			uint8_t *const p = &frame[(y * width + x) * 3];
+			for(int c=0; c<3; c++)
+				p[c] = fg[c] * v / 255;
+		}
+	}
+
+	return frame;
+}
+
+int main(int argc, char *argv[])
+{
+	// 80x25 cells
+	constexpr int width      = 80 * 9;
+	constexpr int height     = 25 * 18;
+	const int     iterations = argc >= 2 ? atoi(argv[1]) : 50;
+
+	const struct {
+		const char *name;
+		bool        colored;
+	} frames[] {
+		{ "monochrome", false },
+		{ "colored",    true  },
+	};
+
+	printf("frame      level  old us/frame  old bytes  new us/frame  new bytes\n");
+
+	for(auto & f: frames) {
+		const std::vector<uint8_t> frame = make_frame(width, height, f.colored);
+
+		for(int level: { 0, 25, 50, 100 }) {
+			uint8_t *reference_out = nullptr;
+			size_t   reference_len = 0;
+
+			uint64_t start = get_ns();
+			for(int i=0; i<iterations; i++) {
+				free(reference_out);
+				reference_write_png(width, height, level, frame.data(), &reference_out, &reference_len);
+			}
+			uint64_t reference_ns = get_ns() - start;
+
+			uint8_t *new_out = nullptr;
+			size_t   new_len = 0;
+
+			start = get_ns();
+			for(int i=0; i<iterations; i++) {
+				free(new_out);
+				write_png(width, height, level, frame.data(), &new_out, &new_len);
+			}
+			uint64_t new_ns = get_ns() - start;
+
+			const bool same = decodes_to(reference_out, reference_len, frame) && decodes_to(new_out, new_len, frame);
+
+			printf("%-10s %5d  %12.1f  %9zu  %12.1f  %9zu%s\n", f.name, level,
+					reference_ns / 1000. / iterations, reference_len, new_ns / 1000. / iterations, new_len, same ? "" : "  (does not decode to the input)");
+
+			free(new_out);
+			free(reference_out);
+		}
+	}
+
+	return 0;
+}
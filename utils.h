@@ -1,3 +1,4 @@
+#include <optional>
 #include <string>
 
 void set_thread_name(std::string name);
@@ -8,6 +8,7 @@
 #include <sys/poll.h>
 #include <sys/socket.h>
 
+#include "frame-bus.h"
 #include "io.h"
 #include "logging.h"
 #include "net.h"
@@ -196,12 +197,10 @@ bool VNCServer::VNCWaitForEvent(int fd, client_state *const cs)
 	return true;
 }
 
-bool VNCServer::VNCSendFrame(int fd, bool first)
+bool VNCServer::VNCSendFrame(int fd, frame *const f)
 {
-	int      w      = 0;
-	int      h      = 0;
-	uint8_t *pixels = nullptr;
-	t->render(&pixels, &w, &h);
+	const int w = f->get_width();
+	const int h = f->get_height();
 
 	uint8_t update[4 + 12];
 	update[0] = 0;  // FrameBufferUpdate
@@ -223,29 +222,16 @@ bool VNCServer::VNCSendFrame(int fd, bool first)
 
 	if (WRITE(fd, update, sizeof update) == false) {
 		dolog(ll_info, "VNC: failed transmitting header");
-		free(pixels);
 		return false;
 	}
 
-	uint8_t *temp = new uint8_t[w * h * 4]();
-	for(int i=0; i<w*h; i++) {
-		int out_off = i * 4;
-		int in_off  = i * 3;
-		temp[out_off + 2] = pixels[in_off + 0];
-		temp[out_off + 1] = pixels[in_off + 1];
-		temp[out_off + 0] = pixels[in_off + 2];
-	}
-	free(pixels);
-
+	// converted once per frame, shared by all VNC clients
 	size_t n_bytes = w * h * 4;
-	if (WRITE(fd, temp, n_bytes) == false) {
+	if (WRITE(fd, f->get_pixels(PF_BGRX), n_bytes) == false) {
 		dolog(ll_info, "VNC: failed transmitting payload");
-		delete [] temp;
 		return false;
 	}
 
-	delete [] temp;
-
 	return true;
 }
 
@@ -254,14 +240,15 @@ void VNCServer::VNCClientThread(int fd)
 	set_thread_name("vnc-client");
 
 	if (VNCSendVersion(fd) && VNCSecurityHandshake(fd) && VNCClientServerInit(fd)) {
-		uint64_t     ts_after = 0;
+		uint64_t     frame_nr = 0;
 		client_state cs { };
-		bool         first    = true;
 		while(!stop_flag) {
-			if (first || t->wait_for_frame(&ts_after, 10)) {
-				if (VNCSendFrame(fd, first) == false)
+			auto f = fb->wait_for_frame(frame_nr, 10);
+
+			if (f != nullptr && f->get_frame_nr() != frame_nr) {
+				if (VNCSendFrame(fd, f.get()) == false)
 					break;
-				first = false;
+				frame_nr = f->get_frame_nr();
 			}
 
 			if (VNCWaitForEvent(fd, &cs) == false)
@@ -2,12 +2,15 @@
 #include <thread>
 
 
+class frame;
+class frame_bus;
 class terminal;
 
 class VNCServer
 {
 private:
 	terminal        *const t   { nullptr };
+	frame_bus       *const fb  { nullptr };
 	const int        port      { 5901    };
 	const bool       vnc_allow_keyboard { false };
 	const int        stdin_fd  { -1      };
@@ -22,12 +25,12 @@ private:
 	bool VNCSecurityHandshake(int fd);
 	bool VNCClientServerInit (int fd);
 	bool VNCWaitForEvent     (int fd, client_state *const cs);
-	bool VNCSendFrame        (int fd, bool first);
+	bool VNCSendFrame        (int fd, frame *const f);
 	void VNCClientThread     (int fd);
 
 public:
-	VNCServer(terminal *const t, const int port, const bool vnc_allow_keyboard, const int stdin_fd) :
-		t(t), port(port), vnc_allow_keyboard(vnc_allow_keyboard), stdin_fd(stdin_fd) {
+	VNCServer(terminal *const t, frame_bus *const fb, const int port, const bool vnc_allow_keyboard, const int stdin_fd) :
+		t(t), fb(fb), port(port), vnc_allow_keyboard(vnc_allow_keyboard), stdin_fd(stdin_fd) {
 	}
 
 	~VNCServer() {
@@ -0,0 +1,85 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#include <algorithm>
+
+#include "logging.h"
+#include "utils.h"
+#include "worker-pool.h"
+
+
+worker_pool::worker_pool(const int n_threads)
+{
+	for(int i=0; i<n_threads; i++)
+		threads.push_back(new std::thread(&worker_pool::worker, this));
+
+	dolog(ll_info, "worker_pool: started %d threads", n_threads);
+}
+
+worker_pool::~worker_pool()
+{
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		stop_flag = true;
+		cond.notify_all();
+	}
+
+	for(auto & th: threads) {
+		th->join();
+		delete th;
+	}
+}
+
+void worker_pool::worker()
+{
+	set_thread_name("worker-pool");
+
+	for(;;) {
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			cond.wait(lck, [this] { return stop_flag || jobs.empty() == false; });
+
+			if (jobs.empty())  // stop_flag
+				break;
+
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+
+		job();
+	}
+}
+
+void worker_pool::run(const std::vector<std::function<void()> > & work)
+{
+	std::mutex              done_lock;
+	std::condition_variable done_cond;
+	size_t                  n_left = work.size();
+
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		for(auto & w: work) {
+			jobs.push([&w, &done_lock, &done_cond, &n_left] {
+					w();
+
+					std::unique_lock<std::mutex> lck(done_lock);
+					if (--n_left == 0)
+						done_cond.notify_all();
+				});
+		}
+
+		cond.notify_all();
+	}
+
+	std::unique_lock<std::mutex> lck(done_lock);
+	done_cond.wait(lck, [&n_left] { return n_left == 0; });
+}
+
+worker_pool & get_encode_pool()
+{
+	static worker_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+
+	return pool;
+}
@@ -0,0 +1,35 @@
+// (C) 2026 by folkert van heusden, released under MIT license
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+// a fixed set of threads to spread the work of a single encode over
+class worker_pool
+{
+private:
+	std::vector<std::thread *>         threads;
+	std::mutex                         lock;
+	std::condition_variable            cond;
+	std::queue<std::function<void()> > jobs;
+	bool                               stop_flag { false };
+
+	void worker();
+
+public:
+	worker_pool(const int n_threads);
+	virtual ~worker_pool();
+
+	int  get_n_threads() const { return threads.size(); }
+
+	// returns when all of 'work' has been done
+	void run(const std::vector<std::function<void()> > & work);
+};
+
+// shared by the image encoders; one thread per core
+worker_pool & get_encode_pool();
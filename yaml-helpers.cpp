@@ -38,6 +38,16 @@ std::optional<int> yaml_get_int_optional(const YAML::Node & node, const std::str
 	}
 }
 
+std::optional<std::string> yaml_get_string_optional(const YAML::Node & node, const std::string & key)
+{
+	try {
+		return node[key].as<std::string>();
+	}
+	catch(YAML::InvalidNode & yin) {
+		return { };
+	}
+}
+
 uint64_t yaml_get_uint64_t(const YAML::Node & node, const std::string & key, const std::string & description, const bool units)
 {
 	try {
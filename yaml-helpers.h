@@ -8,6 +8,7 @@
 std::string        yaml_get_string      (const YAML::Node & node, const std::string & key, const std::string & description);
 int                yaml_get_int         (const YAML::Node & node, const std::string & key, const std::string & description);
 std::optional<int> yaml_get_int_optional(const YAML::Node & node, const std::string & key);
+std::optional<std::string> yaml_get_string_optional(const YAML::Node & node, const std::string & key);
 uint64_t           yaml_get_uint64_t    (const YAML::Node & node, const std::string & key, const std::string & description, const bool units);
 const YAML::Node   yaml_get_yaml_node   (const YAML::Node & node, const std::string & key, const std::string & description);
 bool               yaml_get_bool        (const YAML::Node & node, const std::string & key, const std::string & description);